@@ -0,0 +1,297 @@
+#include "log.h"
+#include "memory.h"
+#include "math.h"
+#include "physics.h"
+#include "jobs.h"
+#include "time.h"
+#include "debug.h"
+#include "str.h"
+#include <execinfo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Headless physics throughput benchmark. Drops boxes and spheres onto a
+// grid of floors and steps the world, printing one CSV row per body count,
+// once with mesh colliders, once with primitive colliders of the same size
+// and once with primitive bodies on triangle mesh floors. Pairs and
+// iterations are averaged per step. Worlds are deterministic, state_hash
+// only differs between builds that simulate differently.
+// After each run, queries are checked against where the update left every
+// body, outside the timing.
+//
+// bench_physics record <file> <bodies> records the primitive scene instead
+// and bench_physics replay <file> runs a recording, so two builds can be
+// timed on the exact same workload.
+
+static Backtrace get_backtrace(u32 backtrace_size)
+{
+    if (backtrace_size > 32)
+        backtrace_size = 32;
+
+    static void* backtraces[32];
+    u32 bt_size = backtrace(backtraces, backtrace_size);
+    char** bt_symbols = backtrace_symbols(backtraces, bt_size);
+    Backtrace bt = {
+        .function_calls = bt_symbols,
+        .function_calls_num = bt_size
+    };
+    return bt;
+}
+
+// Physics draws contact lines through this, there is no renderer here.
+void debug_draw(const Vec3*, u32, const Vec4*, PrimitiveTopology)
+{
+}
+
+static f64 get_cur_time_seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (f64)t.tv_sec + ((f64)t.tv_nsec)/1000000000.0;
+}
+
+#define STEPS 200
+#define STEP_DT (1.0f/60.0f)
+#define BODY_SPACING 3.0f
+#define FLOOR_SIZE 16.0f // floor.wobj is about 17 by 18.6
+
+// colliders are box, sphere and floor.
+static void spawn_scene(PhysicsWorld* w, const PhysicsCollider* colliders, u32 bodies_num)
+{
+    let box_collider = colliders[0];
+    let sphere_collider = colliders[1];
+    let floor_collider = colliders[2];
+    u32 side = 1;
+
+    while (side * side < bodies_num)
+        ++side;
+
+    let grid_size = side * BODY_SPACING;
+    let floors_side = (u32)(grid_size / FLOOR_SIZE) + 1;
+
+    for (u32 y = 0; y < floors_side; ++y)
+        for (u32 x = 0; x < floors_side; ++x)
+            physics_create_object(w, floor_collider, 0, {x * FLOOR_SIZE, y * FLOOR_SIZE, -5}, quat_identity(), {.friction = 0.2f});
+
+    for (u32 i = 0; i < bodies_num; ++i)
+    {
+        let collider = i % 2 ? sphere_collider : box_collider;
+        Vec3 pos = {(i % side) * BODY_SPACING, (i / side) * BODY_SPACING, (f32)(i % 3)};
+        let obj = physics_create_object(w, collider, 0, pos, quat_identity(), {.friction = 0.4f});
+        physics_create_rigidbody(w, obj, 100, vec3_zero);
+    }
+}
+
+struct BenchResult
+{
+    u32 steps;
+    f64 ms_per_step;
+    f64 pairs_tested;
+    f64 gjk_iterations;
+    f64 epa_iterations;
+};
+
+static void accumulate_stats(BenchResult* r, PhysicsWorld* w)
+{
+    let stats = physics_get_stats(w);
+    r->pairs_tested += stats.pairs_tested;
+    r->gjk_iterations += stats.gjk_iterations;
+    r->epa_iterations += stats.epa_iterations;
+    ++r->steps;
+}
+
+static void print_result(const char* colliders, u32 bodies_num, BenchResult r, f64 seconds, PhysicsWorld* w)
+{
+    let steps = r.steps > 0 ? r.steps : 1;
+    printf("%s,%u,%u,%u,%f,%f,%f,%f,%016llx\n", colliders, bodies_num, jobs_workers_num(), r.steps, seconds / steps * 1000.0,
+        r.pairs_tested / steps, r.gjk_iterations / steps, r.epa_iterations / steps, (unsigned long long)physics_get_state_hash(w));
+}
+
+#define QUERY_RAYS_BATCH 256
+
+// Queries right after an update have to find every rigidbody, even ones the
+// solver or CCD moved after broadphase ran. Batched rays have to hit exactly
+// what single ones do.
+static void check_queries(PhysicsWorld* w)
+{
+    let states = physics_get_rigidbody_states(w);
+    PhysicsRay rays[QUERY_RAYS_BATCH];
+    PhysicsRaycastHit hits[QUERY_RAYS_BATCH];
+
+    for (u32 first = 0; first < states.num; first += QUERY_RAYS_BATCH)
+    {
+        let num = states.num - first < QUERY_RAYS_BATCH ? states.num - first : QUERY_RAYS_BATCH;
+
+        for (u32 i = 0; i < num; ++i)
+        {
+            let rb = first + i;
+            let object_idx = states.object_indices[rb];
+            u32 overlapping[16];
+            // Off center, GJK loses track of symmetric shapes that share a center.
+            let inside = states.positions[rb] + Vec3{0.1f, 0.2f, 0.3f};
+            let overlapping_num = physics_overlap_sphere(w, inside, 0.01f, overlapping, 16);
+            bool found = false;
+
+            for (u32 j = 0; j < overlapping_num && j < 16; ++j)
+                found = found || overlapping[j] == object_idx;
+
+            check(found, "Overlap query missed object %u", object_idx);
+            rays[i] = {.origin = states.positions[rb] + Vec3{0, 0, 50}, .dir = {0, 0, -1}, .max_distance = 100};
+        }
+
+        physics_raycast_batch(w, rays, num, hits);
+
+        for (u32 i = 0; i < num; ++i)
+        {
+            PhysicsRaycastHit hit;
+            physics_raycast(w, rays[i], &hit);
+            check(hits[i].object_idx != 0, "Ray down onto object %u hit nothing", states.object_indices[first + i]);
+            check(hit.object_idx == hits[i].object_idx && hit.distance == hits[i].distance, "Batched raycast differs from single one");
+        }
+    }
+}
+
+// A fast sphere bouncing off an elastic floor ends each step far from where
+// broadphase saw it, queries have to follow it anyway.
+static void check_bounce_queries()
+{
+    let w = physics_create_world();
+    physics_set_deterministic(w, 1 / STEP_DT);
+    physics_create_object(w, physics_create_box_collider({8, 8, 1}), 0, {0, 0, -1}, quat_identity(), {.friction = 0.2f, .elasticity = 1});
+    let sphere = physics_create_object(w, physics_create_sphere_collider(0.5f), 0, {0, 0, 5}, quat_identity(), {.friction = 0.2f, .elasticity = 1});
+    physics_create_rigidbody(w, sphere, 1, {0, 0, -60});
+
+    for (u32 s = 0; s < 60; ++s)
+    {
+        physics_update_world(w);
+        let above = physics_get_position(w, sphere) + Vec3{0, 0, 0.45f};
+        PhysicsRay ray = {.origin = above - Vec3{2, 0, 0}, .dir = {1, 0, 0}, .max_distance = 4};
+        PhysicsRaycastHit hit;
+        u32 overlapping = 0;
+        physics_raycast(w, ray, &hit);
+        physics_overlap_sphere(w, above, 0.1f, &overlapping, 1);
+        check(hit.object_idx == sphere, "Raycast missed bouncing sphere at step %u", s);
+        check(overlapping == sphere, "Overlap query missed bouncing sphere at step %u", s);
+    }
+
+    physics_destroy_world(w);
+}
+
+static void replay(const char* filename)
+{
+    let r = physics_replay_load(filename);
+    check(r, "Failed loading physics recording %s", filename);
+    let w = physics_replay_world(r);
+    BenchResult br = {};
+    f64 seconds = 0;
+
+    while (true)
+    {
+        // Only the updates are timed, not the spawning replayed before them.
+        f64 start = get_cur_time_seconds();
+
+        if (!physics_replay_step(r))
+            break;
+
+        seconds += get_cur_time_seconds() - start;
+        accumulate_stats(&br, w);
+    }
+
+    u32 rigidbodies_num = physics_get_rigidbody_states(w).num;
+    print_result("replay", rigidbodies_num, br, seconds, w);
+    physics_replay_destroy(r);
+}
+
+static void record(const char* filename, u32 bodies_num)
+{
+    PhysicsCollider colliders[] = {
+        physics_create_box_collider_from_mesh(physics_load_mesh("box.mesh")),
+        physics_create_sphere_collider(1),
+        physics_create_box_collider_from_mesh(physics_load_mesh("floor.mesh"))
+    };
+
+    let w = physics_create_world();
+    physics_set_deterministic(w, 1 / STEP_DT);
+    physics_start_recording(w);
+    spawn_scene(w, colliders, bodies_num);
+
+    for (u32 s = 0; s < STEPS; ++s)
+        physics_update_world(w);
+
+    check(physics_stop_recording(w, filename), "Failed writing physics recording %s", filename);
+    printf("recorded %u bodies for %u steps to %s, state_hash %016llx\n", bodies_num, STEPS, filename, (unsigned long long)physics_get_state_hash(w));
+    physics_destroy_world(w);
+}
+
+static void run_all()
+{
+    PhysicsCollider mesh_colliders[] = {
+        physics_create_collider(physics_load_mesh("box.mesh")),
+        physics_create_collider(physics_load_mesh("sphere.mesh")),
+        physics_create_collider(physics_load_mesh("floor.mesh"))
+    };
+
+    PhysicsCollider primitive_colliders[] = {
+        physics_create_box_collider_from_mesh(physics_load_mesh("box.mesh")),
+        physics_create_sphere_collider(1),
+        physics_create_box_collider_from_mesh(physics_load_mesh("floor.mesh"))
+    };
+
+    PhysicsCollider triangle_mesh_colliders[] = {
+        physics_create_box_collider_from_mesh(physics_load_mesh("box.mesh")),
+        physics_create_sphere_collider(1),
+        physics_create_triangle_mesh_collider(physics_load_mesh("floor.mesh"))
+    };
+
+    PhysicsCollider* collider_sets[] = {mesh_colliders, primitive_colliders, triangle_mesh_colliders};
+    const char* collider_set_names[] = {"mesh", "primitive", "triangle_mesh"};
+    u32 bodies_nums[] = {10, 100, 1000, 10000};
+
+    check_bounce_queries();
+    printf("colliders,bodies,workers,steps,ms_per_step,pairs_tested,gjk_iterations,epa_iterations,state_hash\n");
+
+    for (u32 run = 0; run < 3 * sizeof(bodies_nums)/sizeof(bodies_nums[0]); ++run)
+    {
+        let collider_set = run % 3;
+        let bodies_num = bodies_nums[run / 3];
+        let w = physics_create_world();
+        physics_set_deterministic(w, 1 / STEP_DT);
+        spawn_scene(w, collider_sets[collider_set], bodies_num);
+
+        BenchResult r = {};
+        f64 start = get_cur_time_seconds();
+
+        for (u32 s = 0; s < STEPS; ++s)
+        {
+            physics_update_world(w);
+            accumulate_stats(&r, w);
+        }
+
+        print_result(collider_set_names[collider_set], bodies_num, r, get_cur_time_seconds() - start, w);
+        check_queries(w);
+        physics_destroy_world(w);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    debug_init(get_backtrace);
+    memory_init();
+    jobs_init();
+    physics_init();
+
+    if (argc == 3 && str_eql(argv[1], "replay"))
+    {
+        printf("colliders,bodies,workers,steps,ms_per_step,pairs_tested,gjk_iterations,epa_iterations,state_hash\n");
+        replay(argv[2]);
+    }
+    else if (argc == 4 && str_eql(argv[1], "record"))
+        record(argv[2], (u32)atoi(argv[3]));
+    else
+        run_all();
+
+    physics_shutdown();
+    jobs_shutdown();
+    memory_check_leaks();
+}
\ No newline at end of file
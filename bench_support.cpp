@@ -0,0 +1,122 @@
+#include "log.h"
+#include "memory.h"
+#include "math.h"
+#include "max_dot.h"
+#include "obj_loader.h"
+#include <execinfo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Compares the GJK support kernels: max_dot_aos (plain Vec3 scan) against
+// max_dot_soa (SIMD when enabled by the build) on the physics meshes.
+
+static Backtrace get_backtrace(u32 backtrace_size)
+{
+    if (backtrace_size > 32)
+        backtrace_size = 32;
+
+    static void* backtraces[32];
+    u32 bt_size = backtrace(backtraces, backtrace_size);
+    char** bt_symbols = backtrace_symbols(backtraces, bt_size);
+    Backtrace bt = {
+        .function_calls = bt_symbols,
+        .function_calls_num = bt_size
+    };
+    return bt;
+}
+
+static f64 get_cur_time_seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (f64)t.tv_sec + ((f64)t.tv_nsec)/1000000000.0;
+}
+
+#define DIRECTIONS_NUM 4096
+#define ROUNDS 200
+
+static const char* kernel_name()
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+int main()
+{
+    debug_init(get_backtrace);
+    memory_init();
+
+    const char* meshes[] = {"box.wobj", "sphere.wobj", "ship.wobj"};
+    Vec3* dirs = mema_tn(Vec3, DIRECTIONS_NUM);
+    srand(1);
+
+    for (u32 i = 0; i < DIRECTIONS_NUM; ++i)
+    {
+        dirs[i] = {
+            (rand() % 2001 - 1000) / 1000.0f,
+            (rand() % 2001 - 1000) / 1000.0f,
+            (rand() % 2001 - 1000) / 1000.0f
+        };
+    }
+
+    info("Support kernel: %s", kernel_name());
+    printf("mesh,vertices,aos_ns_per_query,soa_ns_per_query,speedup\n");
+
+    for (u32 mi = 0; mi < sizeof(meshes)/sizeof(meshes[0]); ++mi)
+    {
+        let olr = obj_load_vertices((char*)meshes[mi]);
+        check(olr.ok, "Failed loading %s", meshes[mi]);
+        let n = olr.vertices_num;
+        let padded_n = ((n + MAX_DOT_SOA_PADDING - 1) / MAX_DOT_SOA_PADDING) * MAX_DOT_SOA_PADDING;
+        f32* soa = mema_tn(f32, padded_n * 3);
+
+        for (u32 i = 0; i < padded_n; ++i)
+        {
+            let v = olr.vertices[i < n ? i : 0];
+            soa[i] = v.x;
+            soa[padded_n + i] = v.y;
+            soa[padded_n * 2 + i] = v.z;
+        }
+
+        for (u32 i = 0; i < DIRECTIONS_NUM; ++i)
+        {
+            let aos_idx = max_dot_aos(olr.vertices, n, dirs[i]);
+            let soa_idx = max_dot_soa(soa, soa + padded_n, soa + padded_n * 2, padded_n, dirs[i]);
+            check(dot(olr.vertices[aos_idx], dirs[i]) == dot(olr.vertices[soa_idx < n ? soa_idx : 0], dirs[i]), "Kernels disagree on %s", meshes[mi]);
+        }
+
+        u64 sink = 0;
+        f64 aos_start = get_cur_time_seconds();
+
+        for (u32 r = 0; r < ROUNDS; ++r)
+            for (u32 i = 0; i < DIRECTIONS_NUM; ++i)
+                sink += max_dot_aos(olr.vertices, n, dirs[i]);
+
+        f64 aos_dt = get_cur_time_seconds() - aos_start;
+        f64 soa_start = get_cur_time_seconds();
+
+        for (u32 r = 0; r < ROUNDS; ++r)
+            for (u32 i = 0; i < DIRECTIONS_NUM; ++i)
+                sink += max_dot_soa(soa, soa + padded_n, soa + padded_n * 2, padded_n, dirs[i]);
+
+        f64 soa_dt = get_cur_time_seconds() - soa_start;
+        f64 queries = (f64)ROUNDS * DIRECTIONS_NUM;
+        printf("%s,%u,%f,%f,%f\n", meshes[mi], n, aos_dt / queries * 1e9, soa_dt / queries * 1e9, aos_dt / soa_dt);
+
+        if (sink == 0)
+            info("sink: %llu", (unsigned long long)sink);
+
+        memf(soa);
+        memf(olr.vertices);
+        memf(olr.indices);
+    }
+
+    memf(dirs);
+    memory_check_leaks();
+}
\ No newline at end of file
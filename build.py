@@ -8,7 +8,7 @@ all_files = os.listdir(".")
 to_compile = []
 shaders = []
 
-entry_files = ["main_linux_xlib_vulkan.cpp", "tests.cpp"]
+entry_files = ["main_linux_xlib_vulkan.cpp", "tests.cpp", "bench_support.cpp", "bench_physics.cpp"]
 
 for f in all_files:
     if not os.path.isfile(f):
@@ -20,11 +20,23 @@ for f in all_files:
     if f.endswith(".glsl"):
         shaders.append(f)
 
+# Physics and what it needs, without the renderer and windowing.
+headless_files = ["physics.cpp", "gjk_epa.cpp", "collide.cpp", "max_dot.cpp", "obj_loader.cpp", "jzon.cpp", "jobs.cpp", "memory.cpp", "log.cpp",
+    "dynamic_array.cpp", "idx_hash_map.cpp", "str.cpp", "file.cpp", "math.cpp", "time.cpp"]
+
 output = "zgae"
+bench = "bench" in sys.argv
 
 if "tests" in sys.argv:
     to_compile.append("tests.cpp")
     output = "tests"
+elif "bench_support" in sys.argv:
+    to_compile.append("bench_support.cpp")
+    output = "bench_support"
+elif bench:
+    to_compile = headless_files + ["bench_physics.cpp"]
+    output = "bench_physics"
+    shaders = []
 else:
     to_compile.append("main_linux_xlib_vulkan.cpp")
 
@@ -38,6 +50,17 @@ extra_flags = [
     "-DENABLE_SLOW_DEBUG_CHECKS"
 ]
 
+# Tracing and slow checks would dominate the timings.
+if bench:
+    extra_flags = []
+
+if "bench_support" in sys.argv or bench:
+    extra_flags.append("-O2")
+
+# Enables the AVX2 paths in max_dot.cpp, SSE2 is used otherwise on x64.
+if "avx2" in sys.argv:
+    extra_flags.append("-mavx2")
+
 if "nounusedwarning" in sys.argv:
     extra_flags.append("-Wno-unused-variable -Wno-unused-parameter")
 
@@ -74,7 +97,8 @@ if static_analysis:
 
 link_start = datetime.now()
 linker_input_str = " ".join(built_objects)
-linker_error = os.WEXITSTATUS(os.system("%s %s -rdynamic -o %s -lrt -lm -lX11 -lvulkan" % (compiler, linker_input_str, output)))
+libs = "-lrt -lm -lpthread" if bench else "-lrt -lm -lpthread -lX11 -lvulkan"
+linker_error = os.WEXITSTATUS(os.system("%s %s -rdynamic -o %s %s" % (compiler, linker_input_str, output, libs)))
 link_end = datetime.now()
 link_dt = link_end - link_start
 total_dt = link_end - compile_start
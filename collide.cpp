@@ -0,0 +1,269 @@
+#include "collide.h"
+#include <math.h>
+
+#define TINY_NUMBER 0.0000001f
+
+// Face axes win over edge axes unless the edge axis is clearly better,
+// otherwise resting boxes flicker between nearly equal axes.
+#define SAT_EDGE_AXIS_TOLERANCE 0.001f
+
+static GjkEpaSolution spheres(const Vec3& p1, f32 r1, const Vec3& p2, f32 r2)
+{
+    let d = p1 - p2;
+    let r = r1 + r2;
+    let dist_sq = dot(d, d);
+
+    if (dist_sq >= r * r)
+        return {.colliding = false};
+
+    let dist = sqrtf(dist_sq);
+    let n = dist > TINY_NUMBER ? d / dist : vec3_up;
+
+    return {
+        .colliding = true,
+        .solution = n * (r - dist),
+        .contact_point = p1 - n * r1
+    };
+}
+
+GjkEpaSolution collide_sphere_sphere(const GjkShape& s1, const GjkShape& s2)
+{
+    return spheres(s1.pos, s1.radius, s2.pos, s2.radius);
+}
+
+GjkEpaSolution collide_sphere_box(const GjkShape& s1, const GjkShape& s2)
+{
+    let e = s2.half_extents;
+    let c = rotate_vec3(inverse(s2.rot), s1.pos - s2.pos);
+
+    Vec3 q = {
+        fminf(fmaxf(c.x, -e.x), e.x),
+        fminf(fmaxf(c.y, -e.y), e.y),
+        fminf(fmaxf(c.z, -e.z), e.z)
+    };
+
+    Vec3 local_n;
+    f32 depth;
+
+    if (!(q == c))
+    {
+        let d = c - q;
+        let dist_sq = dot(d, d);
+
+        if (dist_sq >= s1.radius * s1.radius)
+            return {.colliding = false};
+
+        let dist = sqrtf(dist_sq);
+        local_n = d / dist;
+        depth = s1.radius - dist;
+    }
+    else
+    {
+        // Center is inside, push out through the closest face.
+        f32 face_dist[] = {e.x - fabsf(c.x), e.y - fabsf(c.y), e.z - fabsf(c.z)};
+        f32 sign[] = {c.x < 0 ? -1.0f : 1.0f, c.y < 0 ? -1.0f : 1.0f, c.z < 0 ? -1.0f : 1.0f};
+        u32 axis = 0;
+
+        for (u32 i = 1; i < 3; ++i)
+            if (face_dist[i] < face_dist[axis])
+                axis = i;
+
+        local_n = {
+            axis == 0 ? sign[0] : 0,
+            axis == 1 ? sign[1] : 0,
+            axis == 2 ? sign[2] : 0
+        };
+
+        depth = s1.radius + face_dist[axis];
+    }
+
+    let n = rotate_vec3(s2.rot, local_n);
+
+    return {
+        .colliding = true,
+        .solution = n * depth,
+        .contact_point = s1.pos - n * s1.radius
+    };
+}
+
+static Vec3 capsule_axis(const GjkShape& s)
+{
+    return rotate_vec3(s.rot, {0, 0, s.half_height});
+}
+
+static Vec3 closest_on_segment(const Vec3& p, const Vec3& a, const Vec3& b)
+{
+    let ab = b - a;
+    let ab_len_sq = dot(ab, ab);
+
+    if (ab_len_sq < TINY_NUMBER)
+        return a;
+
+    let t = fminf(fmaxf(dot(p - a, ab) / ab_len_sq, 0), 1);
+    return a + ab * t;
+}
+
+GjkEpaSolution collide_sphere_capsule(const GjkShape& s1, const GjkShape& s2)
+{
+    let axis = capsule_axis(s2);
+    let p2 = closest_on_segment(s1.pos, s2.pos - axis, s2.pos + axis);
+    return spheres(s1.pos, s1.radius, p2, s2.radius);
+}
+
+GjkEpaSolution collide_capsule_capsule(const GjkShape& s1, const GjkShape& s2)
+{
+    // Closest points of the two segments, then it's a sphere test.
+    let axis1 = capsule_axis(s1);
+    let axis2 = capsule_axis(s2);
+    let a1 = s1.pos - axis1;
+    let a2 = s2.pos - axis2;
+    let d1 = axis1 * 2;
+    let d2 = axis2 * 2;
+    let r = a1 - a2;
+    let l1 = dot(d1, d1);
+    let l2 = dot(d2, d2);
+    let f = dot(d2, r);
+    f32 t1 = 0;
+    f32 t2 = 0;
+
+    if (l1 < TINY_NUMBER && l2 < TINY_NUMBER)
+        return spheres(a1, s1.radius, a2, s2.radius);
+
+    if (l1 < TINY_NUMBER)
+        t2 = fminf(fmaxf(f / l2, 0), 1);
+    else
+    {
+        let c = dot(d1, r);
+
+        if (l2 < TINY_NUMBER)
+            t1 = fminf(fmaxf(-c / l1, 0), 1);
+        else
+        {
+            let b = dot(d1, d2);
+            let denom = l1 * l2 - b * b;
+
+            if (denom > TINY_NUMBER)
+                t1 = fminf(fmaxf((b * f - c * l2) / denom, 0), 1);
+
+            t2 = (b * t1 + f) / l2;
+
+            if (t2 < 0)
+            {
+                t2 = 0;
+                t1 = fminf(fmaxf(-c / l1, 0), 1);
+            }
+            else if (t2 > 1)
+            {
+                t2 = 1;
+                t1 = fminf(fmaxf((b - c) / l1, 0), 1);
+            }
+        }
+    }
+
+    return spheres(a1 + d1 * t1, s1.radius, a2 + d2 * t2, s2.radius);
+}
+
+static f32 box_radius_along(const Vec3* axes, const Vec3& e, const Vec3& l)
+{
+    return e.x * fabsf(dot(axes[0], l)) + e.y * fabsf(dot(axes[1], l)) + e.z * fabsf(dot(axes[2], l));
+}
+
+GjkEpaSolution collide_box_box(const GjkShape& s1, const GjkShape& s2)
+{
+    Vec3 axes1[] = {rotate_vec3(s1.rot, {1, 0, 0}), rotate_vec3(s1.rot, {0, 1, 0}), rotate_vec3(s1.rot, {0, 0, 1})};
+    Vec3 axes2[] = {rotate_vec3(s2.rot, {1, 0, 0}), rotate_vec3(s2.rot, {0, 1, 0}), rotate_vec3(s2.rot, {0, 0, 1})};
+    let d = s1.pos - s2.pos;
+    f32 best_overlap = 0;
+    Vec3 best_axis = vec3_zero;
+    u32 best_kind = 0; // 0 face of s2, 1 face of s1, 2 edge-edge
+
+    // Face axes of both boxes, then the nine edge cross products.
+    for (u32 i = 0; i < 15; ++i)
+    {
+        Vec3 l;
+        u32 kind;
+
+        if (i < 3)
+        {
+            l = axes2[i];
+            kind = 0;
+        }
+        else if (i < 6)
+        {
+            l = axes1[i - 3];
+            kind = 1;
+        }
+        else
+        {
+            l = cross(axes1[(i - 6) / 3], axes2[(i - 6) % 3]);
+            let l_len = len(l);
+
+            // Parallel edges, the face axes already cover it.
+            if (l_len < 0.0001f)
+                continue;
+
+            l = l / l_len;
+            kind = 2;
+        }
+
+        let dist = dot(d, l);
+        let overlap = box_radius_along(axes1, s1.half_extents, l) + box_radius_along(axes2, s2.half_extents, l) - fabsf(dist);
+
+        if (overlap < 0)
+            return {.colliding = false};
+
+        let better = kind == 2 ? overlap < best_overlap - SAT_EDGE_AXIS_TOLERANCE : overlap < best_overlap;
+
+        if (best_axis == vec3_zero || better)
+        {
+            best_overlap = overlap;
+            best_axis = dist < 0 ? -l : l;
+            best_kind = kind;
+        }
+    }
+
+    let n = best_axis;
+    Vec3 contact_point;
+
+    if (best_kind == 0)
+        contact_point = gjk_support(s1, -n);
+    else if (best_kind == 1)
+        contact_point = gjk_support(s2, n) - n * best_overlap;
+    else
+        contact_point = (gjk_support(s1, -n) + gjk_support(s2, n)) * 0.5f;
+
+    return {
+        .colliding = true,
+        .solution = n * best_overlap,
+        .contact_point = contact_point
+    };
+}
+
+GjkEpaSolution collide_convex_plane(const GjkShape& s1, const Vec3& plane_pos, const Quat& plane_rot)
+{
+    let n = rotate_vec3(plane_rot, vec3_up);
+    let deepest = gjk_support(s1, -n);
+    let depth = dot(n, plane_pos - deepest);
+
+    if (depth <= 0)
+        return {.colliding = false};
+
+    return {
+        .colliding = true,
+        .solution = n * depth,
+        .contact_point = deepest
+    };
+}
+
+GjkEpaSolution collide_flipped(const GjkEpaSolution& s2_against_s1)
+{
+    if (!s2_against_s1.colliding)
+        return s2_against_s1;
+
+    // The s2 contact point ends up touching s1 once s2 is moved out.
+    return {
+        .colliding = true,
+        .solution = -s2_against_s1.solution,
+        .contact_point = s2_against_s1.contact_point + s2_against_s1.solution
+    };
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+#include "gjk_epa.h"
+
+// Closed-form pair tests for primitive shapes. Same contract as
+// gjk_epa_intersect_and_solve: solution moves s1 out of s2 and
+// contact_point is on the surface of s1.
+
+GjkEpaSolution collide_sphere_sphere(const GjkShape& s1, const GjkShape& s2);
+GjkEpaSolution collide_sphere_box(const GjkShape& s1, const GjkShape& s2);
+GjkEpaSolution collide_sphere_capsule(const GjkShape& s1, const GjkShape& s2);
+GjkEpaSolution collide_capsule_capsule(const GjkShape& s1, const GjkShape& s2);
+GjkEpaSolution collide_box_box(const GjkShape& s1, const GjkShape& s2);
+
+// The plane faces local +z of plane_pos and plane_rot and everything
+// behind it is solid. s1 can be any GjkShape.
+GjkEpaSolution collide_convex_plane(const GjkShape& s1, const Vec3& plane_pos, const Quat& plane_rot);
+
+// Same as the above with s1 and s2 swapped.
+GjkEpaSolution collide_flipped(const GjkEpaSolution& s2_against_s1);
\ No newline at end of file
@@ -19,6 +19,7 @@ struct DynamicArrayHeader
 
 #define da_free(a) (da__destroy((void**)(&(a))))
 #define da_copy_data(a) ((a) ? da__copy_data(a, da__num(a), sizeof(*(a))) : NULL)
+#define da_clear(a) ((a) ? (void)(da__num(a) = 0) : (void)0)
 #define da_pop(a) ((a)[--da__num(a)])
 #define da_last(a) ((a)[da__num(a) - 1])
 #define da_last_ptr(a) ((a) + (da__num(a) - 1))
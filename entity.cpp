@@ -3,6 +3,7 @@
 #include "world.h"
 #include "physics.h"
 #include "renderer.h"
+#include "dynamic_array.h"
 
 Entity entity_create(
     World* w,
@@ -77,6 +78,12 @@ void Entity::set_physics_collider(const PhysicsCollider& collider, const Physics
 {
     let e = get_internal();
     e->physics_object_idx = physics_create_object(e->world->physics_world, collider, e->render_object_idx, e->pos, e->rot, pm);
+    let w = e->world;
+
+    while (da_num(w->physics_object_entities) <= e->physics_object_idx)
+        da_push(w->physics_object_entities, 0u);
+
+    w->physics_object_entities[e->physics_object_idx] = e->idx;
 }
 
 void Entity::set_position(const Vec3& pos)
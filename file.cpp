@@ -25,3 +25,16 @@ FileLoadResult file_load(const char* filename, FileLoadMode mode)
         .data_size = s
     };
 }
+
+
+bool file_write(const char* filename, const void* data, u64 data_size)
+{
+    FILE* file_handle = fopen(filename, "wb");
+
+    if (!file_handle)
+        return false;
+
+    let written = fwrite(data, 1, data_size, file_handle);
+    fclose(file_handle);
+    return written == data_size;
+}
\ No newline at end of file
@@ -12,4 +12,5 @@ enum FileLoadMode
     FILE_LOAD_MODE_RAW, FILE_LOAD_MODE_NULL_TERMINATED
 };
 
-FileLoadResult file_load(const char* filename, FileLoadMode mode = FILE_LOAD_MODE_RAW);
\ No newline at end of file
+FileLoadResult file_load(const char* filename, FileLoadMode mode = FILE_LOAD_MODE_RAW);
+bool file_write(const char* filename, const void* data, u64 data_size);
\ No newline at end of file
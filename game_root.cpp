@@ -48,6 +48,7 @@ void game_init()
     srand (time_since_start());
     let render_world = renderer_create_world();
     let physics_world = physics_create_world();
+    physics_set_fixed_timestep(physics_world, 60, 4);
     gs.world = create_world(render_world, physics_world);
 
     gs.pipeline_idx = renderer_load_pipeline("pipeline_default.pipeline");
@@ -55,12 +56,10 @@ void game_init()
     gs.big_box_render_mesh_idx = renderer_load_mesh("box.mesh");
     let floor_render_mesh = renderer_load_mesh("floor.mesh");
 
-    let box_physics_mesh = physics_load_mesh("box.mesh");
-    let big_box_physics_mesh = physics_load_mesh("box.mesh");
-    let floor_physics_mesh = physics_load_mesh("floor.mesh");
-    gs.box_collider = physics_create_collider(box_physics_mesh);
-    gs.big_box_collider = physics_create_collider(big_box_physics_mesh);
-    let floor_collider = physics_create_collider(floor_physics_mesh);
+    // Sized from the same meshes that are drawn, so they follow the assets.
+    gs.box_collider = physics_create_box_collider_from_mesh(physics_load_mesh("box.mesh"));
+    gs.big_box_collider = physics_create_box_collider_from_mesh(physics_load_mesh("box.mesh"));
+    let floor_collider = physics_create_box_collider_from_mesh(physics_load_mesh("floor.mesh"));
 
     PhysicsMaterial floor_material = {
         .elasticity = 0,
@@ -121,6 +120,16 @@ bool game_update()
     gs.player.update();
     renderer_draw_world(gs.pipeline_idx, gs.world->render_world, gs.player.camera.pos, gs.player.camera.rot);
     renderer_present();
+
+    if (key_went_down(KEY_T))
+    {
+        let ft = renderer_get_frame_timings();
+        info("Frame %.2f ms: CPU %.2f ms, waiting on GPU %.2f ms, GPU %.2f ms", ft.frame_ms, ft.cpu_ms, ft.wait_ms, ft.gpu_ms);
+        let ms = renderer_get_memory_stats();
+        info("GPU memory: %u blocks, %u allocations, %llu of %llu bytes used, %u free ranges, %.2f fragmentation",
+            ms.blocks, ms.allocations, (unsigned long long)ms.used_bytes, (unsigned long long)ms.block_bytes, ms.free_ranges, ms.fragmentation);
+    }
+
     keyboard_end_of_frame();
     mouse_end_of_frame();
 
@@ -1,7 +1,7 @@
 #include "gjk_epa.h"
-#include "dynamic_array.h"
 #include <math.h>
 #include "log.h"
+#include "max_dot.h"
 
 #define TINY_NUMBER 0.0000001f
 #define EPA_QUIT_THRESHOLD 0.01f
@@ -12,28 +12,91 @@ struct SupportDiffPoint
     Vec3 point;
 };
 
-static Vec3 support(const GjkShape& s, const Vec3& d)
+// Walks the hull towards d. On a convex hull the first vertex with no
+// better neighbour is the global maximum.
+static u32 support_hill_climb(const GjkShape& s, const Vec3& d)
 {
-    float max_dot = dot(s.vertices[0], d);
-    size_t max_dot_idx = 0;
+    u32 cur = (s.support_hint && *s.support_hint < s.vertices_num) ? *s.support_hint : 0;
+    float cur_dot = dot(s.vertices[cur], d);
+    bool improved = true;
 
-    for (size_t i = 1; i < s.vertices_num; ++i)
+    while (improved)
     {
-        float cur_dot = dot(s.vertices[i], d);
-        if (cur_dot > max_dot)
+        improved = false;
+
+        for (u32 i = s.adjacency_offsets[cur]; i < s.adjacency_offsets[cur + 1]; ++i)
         {
-            max_dot = cur_dot;
-            max_dot_idx = i;
+            let n = s.adjacency[i];
+            float n_dot = dot(s.vertices[n], d);
+
+            if (n_dot > cur_dot)
+            {
+                cur = n;
+                cur_dot = n_dot;
+                improved = true;
+                break;
+            }
         }
     }
 
-    return s.vertices[max_dot_idx];
+    if (s.support_hint)
+        *s.support_hint = cur;
+
+    return cur;
+}
+
+static Vec3 support_radius(const GjkShape& s, const Vec3& d)
+{
+    let l = len(d);
+    return l > 0 ? d * (s.radius / l) : vec3_zero;
+}
+
+Vec3 gjk_support(const GjkShape& s, const Vec3& d)
+{
+    switch(s.type)
+    {
+        case GJK_SHAPE_TYPE_SPHERE:
+            return s.pos + support_radius(s, d);
+
+        case GJK_SHAPE_TYPE_BOX: {
+            let local_d = rotate_vec3(inverse(s.rot), d);
+            let e = s.half_extents;
+            Vec3 local_p = {local_d.x < 0 ? -e.x : e.x, local_d.y < 0 ? -e.y : e.y, local_d.z < 0 ? -e.z : e.z};
+            return rotate_vec3(s.rot, local_p) + s.pos;
+        }
+
+        case GJK_SHAPE_TYPE_CAPSULE: {
+            let axis = rotate_vec3(s.rot, {0, 0, s.half_height});
+            let end = dot(axis, d) < 0 ? -axis : axis;
+            return s.pos + end + support_radius(s, d);
+        }
+
+        case GJK_SHAPE_TYPE_VERTICES: break;
+    }
+
+    let local_d = rotate_vec3(inverse(s.rot), d);
+    u32 idx;
+
+    if (s.adjacency)
+        idx = support_hill_climb(s, local_d);
+    else if (s.vertices_x)
+    {
+        idx = max_dot_soa(s.vertices_x, s.vertices_y, s.vertices_z, s.vertices_soa_num, local_d);
+
+        // Padding repeats vertex 0.
+        if (idx >= s.vertices_num)
+            idx = 0;
+    }
+    else
+        idx = max_dot_aos(s.vertices, s.vertices_num, local_d);
+
+    return rotate_vec3(s.rot, s.vertices[idx]) + s.pos;
 }
 
 static SupportDiffPoint support_diff(const GjkShape& s1, const GjkShape& s2, const Vec3& d)
 {
-    let point = support(s1, d);
-    let val = point - support(s2, -d);
+    let point = gjk_support(s1, d);
+    let val = point - gjk_support(s2, -d);
     check(val.x == val.x, "NAN!");
     return {.val = val, .point = point};
 }
@@ -179,28 +242,35 @@ struct GjkResult
 {
     bool collision;
     Simplex simplex;
+    Vec3 separating_axis; // only set if collision is false and an axis was found
 };
 
-static GjkResult run_gjk(const GjkShape& s1, const GjkShape& s2)
+static GjkResult run_gjk(const GjkShape& s1, const GjkShape& s2, const Vec3& initial_dir, u32* iterations)
 {
     Simplex s = {};
     GjkStatus status = GJK_STATUS_CONTINUE;
-    let first_point = support_diff(s1, s2, {0, 5, 0});
+    let first_point = support_diff(s1, s2, initial_dir);
+
+    // Whole Minkowski difference is behind initial_dir, common when warm started.
+    if (dot(first_point.val, initial_dir) < 0)
+        return {.collision = false, .separating_axis = initial_dir};
+
     s.vertices[s.size++] = first_point;
     Vec3 search_dir = -first_point.val;
 
     while (status != GJK_STATUS_ABORT)
     {
+        ++*iterations;
         let simplex_candidate = support_diff(s1, s2, search_dir);
         if (dot(simplex_candidate.val, search_dir) <= 0)
-            return {.collision = false};
+            return {.collision = false, .separating_axis = search_dir};
 
         s.vertices[s.size++] = simplex_candidate;
         status = do_simplex(&s, &search_dir);
 
         switch(status)
         {
-            case GJK_STATUS_COLLIDING: return {.collision = true, s};
+            case GJK_STATUS_COLLIDING: return {.collision = true, .simplex = s};
             case GJK_STATUS_ABORT: return {.collision = false};
             default: break;
         }
@@ -209,200 +279,471 @@ static GjkResult run_gjk(const GjkShape& s1, const GjkShape& s2)
     return {.collision = false};
 }
 
+static Vec3 default_search_dir = {0, 5, 0};
+
 bool gjk_intersect(const GjkShape& s1, const GjkShape& s2)
 {
-    return run_gjk(s1, s2).collision;
+    u32 iterations = 0;
+    return run_gjk(s1, s2, default_search_dir, &iterations).collision;
 }
 
-struct EpaFace
-{
-    float distance;
-    Vec3 normal;
-    SupportDiffPoint vertices[3];
-};
+#define GJK_DISTANCE_MAX_ITERATIONS 32
+#define GJK_DISTANCE_TOLERANCE 0.0001f
 
-static EpaFace* find_closest_face(EpaFace* faces)
+// Closest point to the origin on segment, triangle or tetrahedron s.
+// Vertices that don't contribute to it are dropped from s. Zero if the
+// origin is inside a tetrahedron.
+static Vec3 closest_on_simplex(Simplex* s)
 {
-    EpaFace* closest = faces;
-    closest->distance = dot(closest->normal, closest->vertices[0].val);
-    check(closest->distance >= 0, "EPA Face has wrong winding"); // zero is ok, see comment in add_face
-    da_foreach(f, faces)
+    let v = s->vertices;
+
+    switch(s->size)
     {
-        float d = dot(f->normal, f->vertices[0].val);
-        check(d >= 0, "EPA Face has wrong winding");
-        if (d < closest->distance)
-        {
-            f->distance = d;
-            closest = f;
+        case 1: return v[0].val;
+
+        case 2: {
+            let a = v[0].val;
+            let ab = v[1].val - a;
+            let ab_len_sq = dot(ab, ab);
+            let t = ab_len_sq > TINY_NUMBER ? dot(-a, ab) / ab_len_sq : 0;
+
+            if (t <= 0)
+            {
+                s->size = 1;
+                return a;
+            }
+
+            if (t >= 1)
+            {
+                v[0] = v[1];
+                s->size = 1;
+                return v[0].val;
+            }
+
+            return a + ab * t;
+        }
+
+        case 3: {
+            // Voronoi regions of the triangle, as in Ericson's Real-Time Collision Detection.
+            let a = v[0].val;
+            let b = v[1].val;
+            let c = v[2].val;
+            let ab = b - a;
+            let ac = c - a;
+            let d1 = dot(ab, -a);
+            let d2 = dot(ac, -a);
+
+            if (d1 <= 0 && d2 <= 0)
+            {
+                s->size = 1;
+                return a;
+            }
+
+            let d3 = dot(ab, -b);
+            let d4 = dot(ac, -b);
+
+            if (d3 >= 0 && d4 <= d3)
+            {
+                v[0] = v[1];
+                s->size = 1;
+                return b;
+            }
+
+            let vc = d1 * d4 - d3 * d2;
+
+            if (vc <= 0 && d1 >= 0 && d3 <= 0)
+            {
+                s->size = 2;
+                return a + ab * (d1 / (d1 - d3));
+            }
+
+            let d5 = dot(ab, -c);
+            let d6 = dot(ac, -c);
+
+            if (d6 >= 0 && d5 <= d6)
+            {
+                v[0] = v[2];
+                s->size = 1;
+                return c;
+            }
+
+            let vb = d5 * d2 - d1 * d6;
+
+            if (vb <= 0 && d2 >= 0 && d6 <= 0)
+            {
+                v[1] = v[2];
+                s->size = 2;
+                return a + ac * (d2 / (d2 - d6));
+            }
+
+            let va = d3 * d6 - d5 * d4;
+
+            if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+            {
+                v[0] = v[2];
+                s->size = 2;
+                return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+            }
+
+            let denom = 1 / (va + vb + vc);
+            return a + ab * (vb * denom) + ac * (vc * denom);
+        }
+
+        case 4: {
+            // Check the faces that have the origin on their outer side.
+            u32 faces[4][4] = {{0, 1, 2, 3}, {0, 2, 3, 1}, {0, 3, 1, 2}, {1, 3, 2, 0}};
+            bool outside_any = false;
+            Simplex best = {};
+            Vec3 best_p = vec3_zero;
+            f32 best_dist_sq = 0;
+
+            for (u32 i = 0; i < 4; ++i)
+            {
+                let f = faces[i];
+                let a = v[f[0]].val;
+                let n = cross(v[f[1]].val - a, v[f[2]].val - a);
+                let origin_side = dot(-a, n);
+                let opposite_side = dot(v[f[3]].val - a, n);
+
+                // Flat tetrahedrons have no inside, so every face counts.
+                if (origin_side * opposite_side > 0 && fabsf(opposite_side) > TINY_NUMBER)
+                    continue;
+
+                outside_any = true;
+                Simplex face = {.vertices = {v[f[0]], v[f[1]], v[f[2]]}, .size = 3};
+                let p = closest_on_simplex(&face);
+                let dist_sq = dot(p, p);
+
+                if (best.size == 0 || dist_sq < best_dist_sq)
+                {
+                    best = face;
+                    best_p = p;
+                    best_dist_sq = dist_sq;
+                }
+            }
+
+            if (!outside_any)
+                return vec3_zero;
+
+            *s = best;
+            return best_p;
         }
     }
 
-    return closest;
+    error("Invalid simplex size in closest_on_simplex");
+    return vec3_zero;
 }
 
-static void add_face(EpaFace*& faces, const SupportDiffPoint& A, const SupportDiffPoint& B, const SupportDiffPoint& C)
+f32 gjk_distance(const GjkShape& s1, const GjkShape& s2, Vec3* normal)
 {
-    Vec3 AB = B.val - A.val;
-    Vec3 AC = C.val - A.val;
-    Vec3 ABC = cross(AC, AB);
-
-    EpaFace f = {};
-    f.vertices[0] = B;
-    f.vertices[1] = A;
-    f.vertices[2] = C;
+    Simplex s = {};
+    s.vertices[s.size++] = support_diff(s1, s2, s1.pos - s2.pos);
+    Vec3 v = s.vertices[0].val;
 
-    if (ABC == vec3_zero)
+    for (u32 i = 0; i < GJK_DISTANCE_MAX_ITERATIONS; ++i)
     {
-        f.normal = vec3_zero;
-        da_push(faces, f);
-        return;
+        let v_len_sq = dot(v, v);
+
+        if (v_len_sq < TINY_NUMBER)
+            return 0;
+
+        let w = support_diff(s1, s2, -v);
+
+        // No point of the Minkowski difference is meaningfully closer.
+        if (v_len_sq - dot(v, w.val) <= GJK_DISTANCE_TOLERANCE * v_len_sq)
+            break;
+
+        s.vertices[s.size++] = w;
+        v = closest_on_simplex(&s);
     }
 
-    f.normal = normalize(ABC);
-    float normal_dir = dot(f.normal, A.val);
+    let dist = len(v);
+
+    if (dist < TINY_NUMBER)
+        return 0;
+
+    *normal = v / dist;
+    return dist;
+}
+
+// Polytope lives in fixed pools on the stack. Faces know their neighbour
+// across each edge, so the horizon is found by walking out from the
+// removed face instead of deduplicating edges. Faces are never reused, so
+// the heap can hold stale entries that get skipped when popped.
+#define EPA_MAX_VERTICES 128
+#define EPA_MAX_FACES 512
 
-    if (normal_dir < 0)
+struct EpaFace
+{
+    Vec3 normal; // outward, zero for degenerate faces
+    f32 distance; // from origin along normal
+    u16 vertices[3]; // counter-clockwise seen from outside
+    u16 adjacent[3]; // face across edge i, which runs vertices[i] to vertices[i + 1]
+    u8 adjacent_edge[3]; // which edge of the adjacent face is the shared one
+    bool removed;
+};
+
+struct EpaHeapEntry
+{
+    f32 distance;
+    u16 face;
+};
+
+struct EpaPolytope
+{
+    SupportDiffPoint vertices[EPA_MAX_VERTICES];
+    EpaFace faces[EPA_MAX_FACES];
+    EpaHeapEntry heap[EPA_MAX_FACES];
+    u16 horizon_faces[EPA_MAX_FACES];
+    u8 horizon_edges[EPA_MAX_FACES];
+    u16 new_face_by_vertex[EPA_MAX_VERTICES];
+    u32 vertices_num;
+    u32 faces_num;
+    u32 heap_num;
+    u32 horizon_num;
+};
+
+static bool heap_less(const EpaHeapEntry& a, const EpaHeapEntry& b)
+{
+    return a.distance < b.distance || (a.distance == b.distance && a.face < b.face);
+}
+
+static void heap_push(EpaPolytope* p, const EpaHeapEntry& e)
+{
+    u32 i = p->heap_num++;
+    p->heap[i] = e;
+
+    while (i > 0)
     {
-        f.vertices[0] = A;
-        f.vertices[1] = B;
-        f.vertices[2] = C;
-        f.normal = -f.normal;
+        u32 parent = (i - 1) / 2;
+
+        if (!heap_less(p->heap[i], p->heap[parent]))
+            break;
+
+        let tmp = p->heap[i];
+        p->heap[i] = p->heap[parent];
+        p->heap[parent] = tmp;
+        i = parent;
     }
+}
+
+static EpaHeapEntry heap_pop(EpaPolytope* p)
+{
+    let top = p->heap[0];
+    p->heap[0] = p->heap[--p->heap_num];
+    u32 i = 0;
 
-    if (fabs(normal_dir) < TINY_NUMBER)
+    while (true)
     {
-        /* Normal is zero or almsot zero, another case of zero-in-plane.
-           Both this case and the ABC == vec3_zero case will cause algorithm
-           to abort next iteration, since depth must be zero. */
-        f.normal = vec3_zero;
+        u32 l = i * 2 + 1;
+        u32 r = l + 1;
+        u32 smallest = i;
+
+        if (l < p->heap_num && heap_less(p->heap[l], p->heap[smallest]))
+            smallest = l;
+
+        if (r < p->heap_num && heap_less(p->heap[r], p->heap[smallest]))
+            smallest = r;
+
+        if (smallest == i)
+            break;
+
+        let tmp = p->heap[i];
+        p->heap[i] = p->heap[smallest];
+        p->heap[smallest] = tmp;
+        i = smallest;
     }
 
-    da_push(faces, f);
+    return top;
 }
 
-static EpaFace* convert_simplex_to_epa_faces(Simplex& s)
+static u32 add_face(EpaPolytope* p, u32 a, u32 b, u32 c)
 {
-    EpaFace* faces = NULL;
-    for (unsigned i = 0; i < s.size; ++i)
+    let idx = p->faces_num++;
+    let f = p->faces + idx;
+    *f = {};
+    f->vertices[0] = a;
+    f->vertices[1] = b;
+    f->vertices[2] = c;
+
+    let A = p->vertices[a].val;
+    let n = cross(p->vertices[b].val - A, p->vertices[c].val - A);
+
+    if (n == vec3_zero)
+    {
+        // Zero area face. Zero distance makes EPA stop when it's picked.
+        f->normal = vec3_zero;
+        f->distance = 0;
+    }
+    else
     {
-        int j = ((i + 1) == s.size) ? 0 : i + 1;
-        int k = ((j + 1) == s.size) ? 0 : j + 1;
-        let A = s.vertices[i];
-        let B = s.vertices[j];
-        let C = s.vertices[k];
-        add_face(faces, A, B, C);
+        f->normal = normalize(n);
+        f->distance = dot(f->normal, A);
     }
-    return faces;
+
+    heap_push(p, {.distance = f->distance, .face = (u16)idx});
+    return idx;
 }
 
-struct Edge
+static void link_faces(EpaPolytope* p, u32 f1, u32 e1, u32 f2, u32 e2)
 {
-    SupportDiffPoint start;
-    SupportDiffPoint end;
-};
+    p->faces[f1].adjacent[e1] = f2;
+    p->faces[f1].adjacent_edge[e1] = e2;
+    p->faces[f2].adjacent[e2] = f1;
+    p->faces[f2].adjacent_edge[e2] = e1;
+}
 
-static bool remove_edge_if_present(Edge*& edges, const Edge& to_remove)
+static void init_polytope(EpaPolytope* p, const Simplex& s)
 {
-    da_foreach(e, edges)
+    p->vertices_num = 0;
+    p->faces_num = 0;
+    p->heap_num = 0;
+
+    for (u32 i = 0; i < 4; ++i)
+        p->vertices[p->vertices_num++] = s.vertices[i];
+
+    // Wind the tetrahedron so every face points away from the opposite vertex.
+    let v = p->vertices;
+
+    if (dot(cross(v[1].val - v[0].val, v[2].val - v[0].val), v[3].val - v[0].val) > 0)
     {
-        if ((e->start.val == to_remove.end.val && e->end.val == to_remove.start.val) ||
-            (e->start.val == to_remove.start.val && e->end.val == to_remove.end.val))
-        {
-            da_remove(edges, arr_idx(e, edges));
-            return true;
-        }
+        let tmp = v[1];
+        v[1] = v[2];
+        v[2] = tmp;
     }
 
-    return false;
+    add_face(p, 0, 1, 2);
+    add_face(p, 0, 3, 1);
+    add_face(p, 0, 2, 3);
+    add_face(p, 1, 3, 2);
+
+    link_faces(p, 0, 0, 1, 2);
+    link_faces(p, 0, 1, 3, 2);
+    link_faces(p, 0, 2, 2, 0);
+    link_faces(p, 1, 0, 2, 2);
+    link_faces(p, 1, 1, 3, 0);
+    link_faces(p, 2, 1, 3, 1);
+}
+
+static bool face_sees(const EpaPolytope* p, const EpaFace& f, u32 vertex)
+{
+    return dot(f.normal, p->vertices[vertex].val - p->vertices[f.vertices[0]].val) > 0;
 }
 
-static void extend_polytope(EpaFace*& faces, const SupportDiffPoint& extend_to)
+// Removes faces visible from vertex, starting at face_idx, which is entered
+// through edge_idx. Edges to faces that stay become the horizon.
+static void find_horizon(EpaPolytope* p, u32 face_idx, u32 edge_idx, u32 vertex)
 {
-    Edge* edges = NULL;
+    let f = p->faces + face_idx;
 
-    for (unsigned i = 0; i < da_num(faces);)
+    if (f->removed)
+        return;
+
+    if (!face_sees(p, *f, vertex))
     {
-        EpaFace& f = faces[i];
+        p->horizon_faces[p->horizon_num] = face_idx;
+        p->horizon_edges[p->horizon_num] = edge_idx;
+        ++p->horizon_num;
+        return;
+    }
 
-        if (dot(f.normal, extend_to.val-f.vertices[0].val) > 0)
-        {
-            Edge e1 = {f.vertices[0], f.vertices[1]};
-            Edge e2 = {f.vertices[1], f.vertices[2]};
-            Edge e3 = {f.vertices[2], f.vertices[0]};
+    f->removed = true;
+    let e1 = (edge_idx + 1) % 3;
+    let e2 = (edge_idx + 2) % 3;
+    find_horizon(p, f->adjacent[e1], f->adjacent_edge[e1], vertex);
+    find_horizon(p, f->adjacent[e2], f->adjacent_edge[e2], vertex);
+}
 
-            if (!remove_edge_if_present(edges, e1))
-                da_push(edges, e1);
+// Returns false if the pools can't fit the extension.
+static bool extend_polytope(EpaPolytope* p, u32 closest_face, const SupportDiffPoint& extend_to)
+{
+    if (p->vertices_num == EPA_MAX_VERTICES)
+        return false;
 
-            if (!remove_edge_if_present(edges, e2))
-                da_push(edges, e2);
+    let vertex = p->vertices_num++;
+    p->vertices[vertex] = extend_to;
+    p->horizon_num = 0;
 
-            if (!remove_edge_if_present(edges, e3))
-                da_push(edges, e3);
+    let cf = p->faces + closest_face;
+    cf->removed = true;
 
-            da_remove(faces, i);
-        }
-        else
-            ++i;
+    for (u32 i = 0; i < 3; ++i)
+        find_horizon(p, cf->adjacent[i], cf->adjacent_edge[i], vertex);
+
+    if (p->faces_num + p->horizon_num > EPA_MAX_FACES)
+        return false;
+
+    let first_new_face = p->faces_num;
+
+    for (u32 i = 0; i < p->horizon_num; ++i)
+    {
+        let hf = p->horizon_faces[i];
+        let he = p->horizon_edges[i];
+        let a = p->faces[hf].vertices[he];
+        let b = p->faces[hf].vertices[(he + 1) % 3];
+        let nf = add_face(p, b, a, vertex);
+        link_faces(p, nf, 0, hf, he);
+        p->new_face_by_vertex[b] = nf;
     }
 
-    da_foreach(e, edges)
-        add_face(faces, extend_to, e->start, e->end);
+    // New face (b, a, vertex) shares its edge from a to vertex with the
+    // new face that starts at a.
+    for (u32 nf = first_new_face; nf < p->faces_num; ++nf)
+        link_faces(p, nf, 1, p->new_face_by_vertex[p->faces[nf].vertices[1]], 2);
 
-    da_free(edges);
+    return true;
 }
 
 struct EpaSolution
 {
     bool solution_found;
-    EpaFace face;
+    Vec3 normal;
+    SupportDiffPoint face_vertices[3];
     Vec3 solution;
 };
 
-static EpaSolution run_epa(const GjkShape& s1, const GjkShape& s2, Simplex* s)
+static EpaSolution epa_solution(const EpaPolytope& p, const EpaFace& f, const Vec3& solution)
+{
+    return {
+        .solution_found = true,
+        .normal = f.normal,
+        .face_vertices = {p.vertices[f.vertices[0]], p.vertices[f.vertices[1]], p.vertices[f.vertices[2]]},
+        .solution = solution
+    };
+}
+
+static EpaSolution run_epa(const GjkShape& s1, const GjkShape& s2, Simplex* s, u32* iterations)
 {
     check(s->size == 4, "Trying to run EPA with non-tetrahedron simplex.");
 
-    EpaFace* faces = convert_simplex_to_epa_faces(*s);
+    EpaPolytope p;
+    init_polytope(&p, *s);
 
-    while(true)
+    while (true)
     {
-        if (da_num(faces) == 0)
-        {
-            da_free(faces);
+        if (p.heap_num == 0)
             return {.solution_found = false};
-        }
 
-        EpaFace* f = find_closest_face(faces);
-        let dp = support_diff(s1, s2, f->normal);
-        float depth = dot(dp.val, f->normal);
+        let closest = heap_pop(&p);
+        let f = p.faces + closest.face;
+
+        if (f->removed)
+            continue;
+
+        ++*iterations;
 
         if (fabs(f->distance) < TINY_NUMBER)
         {
-            da_free(faces);
             // Origin is on face, so depth will be zero. Solution is zero vector.
-            return {
-                .solution_found = true,
-                .face = *f,
-                .solution = {0, 0, 0}
-            };
+            return epa_solution(p, *f, {0, 0, 0});
         }
 
-        if (fabs(depth - f->distance) < EPA_QUIT_THRESHOLD)
-        {
-            Vec3 sol = -f->normal * depth;
-            da_free(faces);
-            return {
-                .solution_found = true,
-                .face = *f,
-                .solution = sol
-            };
-        }
+        let dp = support_diff(s1, s2, f->normal);
+        float depth = dot(dp.val, f->normal);
 
-        extend_polytope(faces, dp);
+        if (fabs(depth - f->distance) < EPA_QUIT_THRESHOLD || !extend_polytope(&p, closest.face, dp))
+            return epa_solution(p, *f, -f->normal * depth);
     }
-
-    da_free(faces);
-    return {.solution_found = false};
 }
 
 static Vec3 barycentric(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c)
@@ -414,7 +755,12 @@ static Vec3 barycentric(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3&
     f32 d20 = dot(v2, v0);
     f32 d21 = dot(v2, v1);
     f32 denom = d00 * d11 - d01 * d01;
-    check(denom != 0, "Denominator in barycentric coord calc is zero");
+
+    // Flat shapes such as triangles can leave EPA with a face of no area,
+    // its first vertex is then as good a contact as any.
+    if (denom == 0)
+        return {1, 0, 0};
+
     f32 v = (d11 * d20 - d01 * d21) / denom;
     f32 w = (d00 * d21 - d01 * d20) / denom;
     return {
@@ -424,20 +770,34 @@ static Vec3 barycentric(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3&
     };
 }
 
-GjkEpaSolution gjk_epa_intersect_and_solve(const GjkShape& s1, const GjkShape& s2)
+static GjkEpaSolution solve(const GjkShape& s1, const GjkShape& s2, const Vec3& initial_dir, Vec3* next_search_dir, GjkEpaStats* stats)
 {
-    GjkResult res = run_gjk(s1, s2);
+    GjkEpaStats unused_stats = {};
+
+    if (!stats)
+        stats = &unused_stats;
+
+    GjkResult res = run_gjk(s1, s2, initial_dir, &stats->gjk_iterations);
 
     if (!res.collision)
+    {
+        if (!(res.separating_axis == vec3_zero))
+            *next_search_dir = res.separating_axis;
+
         return {.colliding = false};
+    }
 
-    let epa_result = run_epa(s1, s2, &res.simplex);
+    let epa_result = run_epa(s1, s2, &res.simplex, &stats->epa_iterations);
 
     if (!epa_result.solution_found)
         return {.colliding = false};
 
-    let bary = barycentric(-epa_result.solution, epa_result.face.vertices[0].val, epa_result.face.vertices[1].val, epa_result.face.vertices[2].val);
-    Vec3 contact_point = bary.x * epa_result.face.vertices[0].point + bary.y * epa_result.face.vertices[1].point + bary.z * epa_result.face.vertices[2].point;
+    if (!(epa_result.normal == vec3_zero))
+        *next_search_dir = epa_result.normal;
+
+    let fv = epa_result.face_vertices;
+    let bary = barycentric(-epa_result.solution, fv[0].val, fv[1].val, fv[2].val);
+    Vec3 contact_point = bary.x * fv[0].point + bary.y * fv[1].point + bary.z * fv[2].point;
     check(contact_point.z == contact_point.z, "NAN");
 
     return {
@@ -445,4 +805,59 @@ GjkEpaSolution gjk_epa_intersect_and_solve(const GjkShape& s1, const GjkShape& s
         .solution = epa_result.solution,
         .contact_point = contact_point
     };
+}
+
+#define CACHE_REUSE_THRESHOLD 0.00001f
+
+static bool almost_eql(const Quat& q1, const Quat& q2)
+{
+    return almost_eql(Vec4{q1.x, q1.y, q1.z, q1.w}, Vec4{q2.x, q2.y, q2.z, q2.w}, CACHE_REUSE_THRESHOLD);
+}
+
+GjkEpaSolution gjk_epa_intersect_and_solve(const GjkShape& s1, const GjkShape& s2, GjkEpaCache* cache, GjkEpaStats* stats)
+{
+    if (!cache)
+    {
+        Vec3 unused_dir;
+        return solve(s1, s2, default_search_dir, &unused_dir, stats);
+    }
+
+    let inv_rot1 = inverse(s1.rot);
+    let rel_pos = rotate_vec3(inv_rot1, s2.pos - s1.pos);
+    let rel_rot = inv_rot1 * s2.rot;
+
+    if (cache->valid && almost_eql(rel_pos, cache->rel_pos, CACHE_REUSE_THRESHOLD) && almost_eql(rel_rot, cache->rel_rot))
+    {
+        if (stats)
+            ++stats->cache_hits;
+
+        let lr = cache->local_result;
+
+        if (!lr.colliding)
+            return {.colliding = false};
+
+        return {
+            .colliding = true,
+            .solution = rotate_vec3(s1.rot, lr.solution),
+            .contact_point = rotate_vec3(s1.rot, lr.contact_point) + s1.pos
+        };
+    }
+
+    GjkShape hinted_s1 = s1;
+    GjkShape hinted_s2 = s2;
+    hinted_s1.support_hint = &cache->support_hint1;
+    hinted_s2.support_hint = &cache->support_hint2;
+    let initial_dir = cache->search_dir == vec3_zero ? default_search_dir : cache->search_dir;
+    let res = solve(hinted_s1, hinted_s2, initial_dir, &cache->search_dir, stats);
+
+    cache->valid = true;
+    cache->rel_pos = rel_pos;
+    cache->rel_rot = rel_rot;
+    cache->local_result = {
+        .colliding = res.colliding,
+        .solution = rotate_vec3(inv_rot1, res.solution),
+        .contact_point = rotate_vec3(inv_rot1, res.contact_point - s1.pos)
+    };
+
+    return res;
 }
\ No newline at end of file
@@ -1,10 +1,46 @@
 #pragma once
 #include "math.h"
 
+enum GjkShapeType
+{
+    GJK_SHAPE_TYPE_VERTICES,
+    GJK_SHAPE_TYPE_SPHERE,
+    GJK_SHAPE_TYPE_BOX,
+    GJK_SHAPE_TYPE_CAPSULE
+};
+
+// Convex point cloud. Vertices are in local space and are placed in the
+// world by pos and rot, so shapes can share vertex data.
 struct GjkShape
 {
-    Vec3* vertices;
+    const Vec3* vertices;
     u32 vertices_num;
+    Vec3 pos;
+    Quat rot;
+
+    // Optional. Neighbours of vertex i are adjacency[adjacency_offsets[i]]
+    // up to adjacency[adjacency_offsets[i + 1]]. Must describe a convex
+    // hull, support points are then found by hill climbing.
+    const u32* adjacency_offsets;
+    const u32* adjacency;
+
+    // Optional. Vertex hill climbing starts from, updated with each result.
+    u32* support_hint;
+
+    // Optional. Vertices as separate x, y and z arrays, each
+    // vertices_soa_num long, padded as required by max_dot_soa.
+    // Used for linear scan support when there is no adjacency.
+    const f32* vertices_x;
+    const f32* vertices_y;
+    const f32* vertices_z;
+    u32 vertices_soa_num;
+
+    // Shapes other than GJK_SHAPE_TYPE_VERTICES have closed-form support
+    // points and ignore the vertex fields above.
+    GjkShapeType type;
+    f32 radius; // sphere and capsule
+    f32 half_height; // capsule, its segment runs along local z from -half_height to half_height
+    Vec3 half_extents; // box
 };
 
 struct GjkEpaSolution
@@ -14,5 +50,32 @@ struct GjkEpaSolution
     Vec3 contact_point;
 };
 
+// State kept between calls for the same pair of shapes, zero-initialise
+// before first use. Warm starts GJK and skips the test completely if s2
+// hasn't moved relative to s1 since the last call.
+struct GjkEpaCache
+{
+    bool valid;
+    Vec3 search_dir; // last separating axis or penetration normal
+    u32 support_hint1;
+    u32 support_hint2;
+    Vec3 rel_pos; // s2 in the space of s1 when local_result was computed
+    Quat rel_rot;
+    GjkEpaSolution local_result; // solution and contact_point in the space of s1
+};
+
+struct GjkEpaStats
+{
+    u32 cache_hits;
+    u32 gjk_iterations;
+    u32 epa_iterations;
+};
+
+// Furthest point of s in world space direction d, in world space.
+Vec3 gjk_support(const GjkShape& s, const Vec3& d);
 bool gjk_intersect(const GjkShape& s1, const GjkShape& s2);
-GjkEpaSolution gjk_epa_intersect_and_solve(const GjkShape& s1, const GjkShape& s2);
+
+// Distance between the shapes, zero if they overlap. If not, normal is set
+// to the direction from the closest point of s2 to the closest point of s1.
+f32 gjk_distance(const GjkShape& s1, const GjkShape& s2, Vec3* normal);
+GjkEpaSolution gjk_epa_intersect_and_solve(const GjkShape& s1, const GjkShape& s2, GjkEpaCache* cache = NULL, GjkEpaStats* stats = NULL);
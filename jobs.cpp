@@ -0,0 +1,240 @@
+#include "jobs.h"
+#include "memory.h"
+#include "log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+struct Job
+{
+    JobRangeFunc func;
+    void* data;
+    u32 start;
+    u32 end;
+    u32* remaining; // decremented when done
+};
+
+#define JOB_QUEUE_CAPACITY 1024
+
+// Owner pushes and pops at tail, thieves take from head.
+struct JobQueue
+{
+    pthread_mutex_t mutex;
+    Job jobs[JOB_QUEUE_CAPACITY];
+    u32 head;
+    u32 tail;
+};
+
+struct JobSystem
+{
+    pthread_t* threads;
+    JobQueue* queues; // workers_num + 1, last one belongs to the thread that ran jobs_init
+    u32 workers_num;
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake_cond;
+    u32 queued; // atomic, jobs sitting in any queue
+    bool shutdown;
+};
+
+static JobSystem js = {};
+static bool inited = false;
+
+static bool queue_push(JobQueue* q, const Job& j)
+{
+    pthread_mutex_lock(&q->mutex);
+    bool full = q->tail - q->head == JOB_QUEUE_CAPACITY;
+
+    if (!full)
+        q->jobs[(q->tail++) % JOB_QUEUE_CAPACITY] = j;
+
+    pthread_mutex_unlock(&q->mutex);
+    return !full;
+}
+
+static bool queue_pop(JobQueue* q, Job* out)
+{
+    pthread_mutex_lock(&q->mutex);
+    bool found = q->tail != q->head;
+
+    if (found)
+        *out = q->jobs[(--q->tail) % JOB_QUEUE_CAPACITY];
+
+    pthread_mutex_unlock(&q->mutex);
+    return found;
+}
+
+static bool queue_steal(JobQueue* q, Job* out)
+{
+    pthread_mutex_lock(&q->mutex);
+    bool found = q->tail != q->head;
+
+    if (found)
+        *out = q->jobs[(q->head++) % JOB_QUEUE_CAPACITY];
+
+    pthread_mutex_unlock(&q->mutex);
+    return found;
+}
+
+static bool find_job(u32 queue_idx, Job* out)
+{
+    let queues_num = js.workers_num + 1;
+
+    if (queue_pop(js.queues + queue_idx, out))
+    {
+        __atomic_sub_fetch(&js.queued, 1, __ATOMIC_SEQ_CST);
+        return true;
+    }
+
+    for (u32 i = 1; i < queues_num; ++i)
+    {
+        if (queue_steal(js.queues + (queue_idx + i) % queues_num, out))
+        {
+            __atomic_sub_fetch(&js.queued, 1, __ATOMIC_SEQ_CST);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void run_job(const Job& j)
+{
+    j.func(j.data, j.start, j.end);
+    __atomic_sub_fetch(j.remaining, 1, __ATOMIC_SEQ_CST);
+}
+
+static void* worker_main(void* arg)
+{
+    let queue_idx = (u32)(u64)arg;
+
+    while (true)
+    {
+        Job j;
+
+        if (find_job(queue_idx, &j))
+        {
+            run_job(j);
+            continue;
+        }
+
+        pthread_mutex_lock(&js.wake_mutex);
+
+        while (!js.shutdown && __atomic_load_n(&js.queued, __ATOMIC_SEQ_CST) == 0)
+            pthread_cond_wait(&js.wake_cond, &js.wake_mutex);
+
+        bool stop = js.shutdown;
+        pthread_mutex_unlock(&js.wake_mutex);
+
+        if (stop)
+            return NULL;
+    }
+}
+
+void jobs_init(u32 workers_num)
+{
+    check(!inited, "Trying to init jobs twice");
+    inited = true;
+
+    if (workers_num == 0)
+    {
+        i64 cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers_num = cores > 1 ? (u32)(cores - 1) : 0;
+    }
+
+    js.workers_num = workers_num;
+    let queues_num = workers_num + 1;
+    js.queues = mema_zero_tn(JobQueue, queues_num);
+
+    for (u32 i = 0; i < queues_num; ++i)
+        pthread_mutex_init(&js.queues[i].mutex, NULL);
+
+    pthread_mutex_init(&js.wake_mutex, NULL);
+    pthread_cond_init(&js.wake_cond, NULL);
+    js.threads = mema_zero_tn(pthread_t, workers_num);
+
+    for (u32 i = 0; i < workers_num; ++i)
+    {
+        let err = pthread_create(js.threads + i, NULL, worker_main, (void*)(u64)i);
+        check(err == 0, "Failed creating job worker thread");
+    }
+
+    info("Job system started with %d workers", workers_num);
+}
+
+void jobs_shutdown()
+{
+    check(inited, "Trying to shut down jobs without init");
+    pthread_mutex_lock(&js.wake_mutex);
+    js.shutdown = true;
+    pthread_cond_broadcast(&js.wake_cond);
+    pthread_mutex_unlock(&js.wake_mutex);
+
+    for (u32 i = 0; i < js.workers_num; ++i)
+        pthread_join(js.threads[i], NULL);
+
+    for (u32 i = 0; i < js.workers_num + 1; ++i)
+        pthread_mutex_destroy(&js.queues[i].mutex);
+
+    pthread_mutex_destroy(&js.wake_mutex);
+    pthread_cond_destroy(&js.wake_cond);
+    memf(js.threads);
+    memf(js.queues);
+    js = {};
+    inited = false;
+}
+
+u32 jobs_workers_num()
+{
+    return js.workers_num;
+}
+
+void jobs_parallel_for(u32 items_num, u32 batch_size, JobRangeFunc func, void* data)
+{
+    check(batch_size > 0, "Job batch size must be above zero");
+
+    if (!inited || js.workers_num == 0 || items_num <= batch_size)
+    {
+        if (items_num > 0)
+            func(data, 0, items_num);
+
+        return;
+    }
+
+    let queues_num = js.workers_num + 1;
+    let own_queue_idx = js.workers_num;
+    u32 batches_num = (items_num + batch_size - 1) / batch_size;
+    u32 remaining = batches_num;
+
+    for (u32 b = 0; b < batches_num; ++b)
+    {
+        let start = b * batch_size;
+        let end = start + batch_size < items_num ? start + batch_size : items_num;
+
+        Job j = {
+            .func = func,
+            .data = data,
+            .start = start,
+            .end = end,
+            .remaining = &remaining
+        };
+
+        if (queue_push(js.queues + b % queues_num, j))
+            __atomic_add_fetch(&js.queued, 1, __ATOMIC_SEQ_CST);
+        else
+            run_job(j);
+    }
+
+    pthread_mutex_lock(&js.wake_mutex);
+    pthread_cond_broadcast(&js.wake_cond);
+    pthread_mutex_unlock(&js.wake_mutex);
+
+    while (__atomic_load_n(&remaining, __ATOMIC_SEQ_CST) > 0)
+    {
+        Job j;
+
+        if (find_job(own_queue_idx, &j))
+            run_job(j);
+        else
+            sched_yield();
+    }
+}
\ No newline at end of file
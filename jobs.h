@@ -0,0 +1,17 @@
+#pragma once
+
+// Runs over the item range [start, end).
+typedef void(*JobRangeFunc)(void* data, u32 start, u32 end);
+
+// Starts worker threads. Zero workers_num means one per core, not
+// counting the calling thread, which also runs jobs while it waits.
+void jobs_init(u32 workers_num = 0);
+void jobs_shutdown();
+u32 jobs_workers_num();
+
+// Splits [0, items_num) into batches of batch_size and runs them spread
+// over all workers and the calling thread. Returns once every batch is
+// done. Idle workers steal batches from busy ones. Runs everything on
+// the calling thread if jobs_init wasn't called or there is only one
+// batch. Only call from the thread that ran jobs_init.
+void jobs_parallel_for(u32 items_num, u32 batch_size, JobRangeFunc func, void* data);
\ No newline at end of file
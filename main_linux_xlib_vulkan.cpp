@@ -8,6 +8,7 @@
 #include "renderer.h"
 #include "mouse.h"
 #include "game_root.h"
+#include "jobs.h"
 #include <time.h>
 
 static f32 get_cur_time_seconds()
@@ -54,6 +55,7 @@ int main()
     debug_init(get_backtrace);
     memory_init();
     keyboard_init();
+    jobs_init();
 
     Display* display = XOpenDisplay(NULL);
     i32 screen = XDefaultScreen(display);
@@ -222,6 +224,7 @@ int main()
     info("Main loop exited, shutting down");
     physics_shutdown();
     renderer_shutdown();
+    jobs_shutdown();
 
     if (!closed_by_wm) // May crash because display is already gone if we dont do this
     {
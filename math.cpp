@@ -228,6 +228,11 @@ Vec3 project(const Vec3& v, const Vec3& on)
     return dot(v, unit_dir) * unit_dir;
 }
 
+Vec3 lerp(const Vec3& from, const Vec3& to, f32 t)
+{
+    return from + (to - from) * t;
+}
+
 Vec2 operator*(const Vec2i& v, f32 s)
 {
     return { v.x * s, v.y * s };
@@ -274,6 +279,11 @@ void operator*=(Quat& a, const Quat& b)
     a = a * b;
 }
 
+bool operator==(const Quat& a, const Quat& b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
 Quat quat_rotate_x(const Quat& q, float rads)
 {
     float adjusted_rads = rads * 0.5f; 
@@ -341,6 +351,26 @@ Quat normalize(const Quat& q)
     };
 }
     
+Quat inverse(const Quat& q)
+{
+    // Rotation quaternions are unit length, so the conjugate is the inverse.
+    return {-q.x, -q.y, -q.z, q.w};
+}
+
+Quat nlerp(const Quat& from, const Quat& to, f32 t)
+{
+    // Go the short way around, q and -q are the same rotation.
+    f32 d = from.x * to.x + from.y * to.y + from.z * to.z + from.w * to.w;
+    f32 s = d < 0 ? -1.0f : 1.0f;
+
+    return normalize({
+        from.x + (to.x * s - from.x) * t,
+        from.y + (to.y * s - from.y) * t,
+        from.z + (to.z * s - from.z) * t,
+        from.w + (to.w * s - from.w) * t
+    });
+}
+
 Vec3 rotate_vec3(const Quat& q, const Vec3& v)
 {
     const Vec3 qv = {q.x, q.y, q.z};
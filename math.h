@@ -71,6 +71,7 @@ bool operator==(const Vec3& v1, const Vec3& v2);
 Vec3 cross(const Vec3& v1, const Vec3& v2);
 Vec2 operator*(const Vec2i& v, f32 s);
 Vec3 project(const Vec3& v, const Vec3& on);
+Vec3 lerp(const Vec3& from, const Vec3& to, f32 t);
 
 
 #define ALMOST_EQL_DEF_THRESHOLD 0.000001f
@@ -82,11 +83,14 @@ bool almost_eql(const Vec4& v1, const Vec4& v2, f32 thres = ALMOST_EQL_DEF_THRES
 Quat quat_identity();
 Quat operator*(const Quat& a, const Quat& b);
 void operator*=(Quat& a, const Quat& b);
+bool operator==(const Quat& a, const Quat& b);
 Quat quat_rotate_x(const Quat& q, float rads);
 Quat quat_rotate_y(const Quat& q, float rads);
 Quat quat_rotate_z(const Quat& q, float rads);
 Quat quat_from_axis_angle(const Vec3& axis, float angle);
 Quat normalize(const Quat& q);
+Quat inverse(const Quat& q);
+Quat nlerp(const Quat& from, const Quat& to, f32 t);
 Vec3 rotate_vec3(const Quat&q, const Vec3& v);
 
 f32 clamp(f32 v, f32 minv, f32 maxv);
@@ -0,0 +1,124 @@
+#include "max_dot.h"
+#include "math.h"
+#include "log.h"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+u32 max_dot_aos(const Vec3* points, u32 points_num, const Vec3& d)
+{
+    f32 max_dot = dot(points[0], d);
+    u32 max_dot_idx = 0;
+
+    for (u32 i = 1; i < points_num; ++i)
+    {
+        f32 cur_dot = dot(points[i], d);
+
+        if (cur_dot > max_dot)
+        {
+            max_dot = cur_dot;
+            max_dot_idx = i;
+        }
+    }
+
+    return max_dot_idx;
+}
+
+// Picks the best lane, lowest index wins ties so the result matches max_dot_aos.
+static u32 reduce_lanes(const f32* lane_dots, const i32* lane_idxs, u32 lanes_num)
+{
+    u32 best = 0;
+
+    for (u32 i = 1; i < lanes_num; ++i)
+    {
+        if (lane_dots[i] > lane_dots[best] || (lane_dots[i] == lane_dots[best] && lane_idxs[i] < lane_idxs[best]))
+            best = i;
+    }
+
+    return lane_idxs[best];
+}
+
+u32 max_dot_soa(const f32* xs, const f32* ys, const f32* zs, u32 points_num_padded, const Vec3& d)
+{
+    check_slow(points_num_padded % MAX_DOT_SOA_PADDING == 0, "max_dot_soa input isn't padded");
+
+#if defined(__AVX2__)
+    let dx = _mm256_set1_ps(d.x);
+    let dy = _mm256_set1_ps(d.y);
+    let dz = _mm256_set1_ps(d.z);
+    let step = _mm256_set1_epi32(8);
+    __m256i idxs = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i best_idxs = idxs;
+    __m256 best_dots = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_loadu_ps(xs), dx),
+        _mm256_mul_ps(_mm256_loadu_ps(ys), dy)),
+        _mm256_mul_ps(_mm256_loadu_ps(zs), dz));
+
+    for (u32 i = 8; i < points_num_padded; i += 8)
+    {
+        idxs = _mm256_add_epi32(idxs, step);
+        let dots = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_loadu_ps(xs + i), dx),
+            _mm256_mul_ps(_mm256_loadu_ps(ys + i), dy)),
+            _mm256_mul_ps(_mm256_loadu_ps(zs + i), dz));
+        let greater = _mm256_cmp_ps(dots, best_dots, _CMP_GT_OQ);
+        best_dots = _mm256_blendv_ps(best_dots, dots, greater);
+        best_idxs = _mm256_blendv_epi8(best_idxs, idxs, _mm256_castps_si256(greater));
+    }
+
+    alignas(32) f32 lane_dots[8];
+    alignas(32) i32 lane_idxs[8];
+    _mm256_store_ps(lane_dots, best_dots);
+    _mm256_store_si256((__m256i*)lane_idxs, best_idxs);
+    return reduce_lanes(lane_dots, lane_idxs, 8);
+#elif defined(__SSE2__)
+    let dx = _mm_set1_ps(d.x);
+    let dy = _mm_set1_ps(d.y);
+    let dz = _mm_set1_ps(d.z);
+    let step = _mm_set1_epi32(4);
+    __m128i idxs = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i best_idxs = idxs;
+    __m128 best_dots = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(_mm_loadu_ps(xs), dx),
+        _mm_mul_ps(_mm_loadu_ps(ys), dy)),
+        _mm_mul_ps(_mm_loadu_ps(zs), dz));
+
+    for (u32 i = 4; i < points_num_padded; i += 4)
+    {
+        idxs = _mm_add_epi32(idxs, step);
+        let dots = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_loadu_ps(xs + i), dx),
+            _mm_mul_ps(_mm_loadu_ps(ys + i), dy)),
+            _mm_mul_ps(_mm_loadu_ps(zs + i), dz));
+        let greater = _mm_cmpgt_ps(dots, best_dots);
+        let greater_i = _mm_castps_si128(greater);
+        best_dots = _mm_or_ps(_mm_and_ps(greater, dots), _mm_andnot_ps(greater, best_dots));
+        best_idxs = _mm_or_si128(_mm_and_si128(greater_i, idxs), _mm_andnot_si128(greater_i, best_idxs));
+    }
+
+    alignas(16) f32 lane_dots[4];
+    alignas(16) i32 lane_idxs[4];
+    _mm_store_ps(lane_dots, best_dots);
+    _mm_store_si128((__m128i*)lane_idxs, best_idxs);
+    return reduce_lanes(lane_dots, lane_idxs, 4);
+#else
+    f32 max_dot = xs[0] * d.x + ys[0] * d.y + zs[0] * d.z;
+    u32 max_dot_idx = 0;
+
+    for (u32 i = 1; i < points_num_padded; ++i)
+    {
+        f32 cur_dot = xs[i] * d.x + ys[i] * d.y + zs[i] * d.z;
+
+        if (cur_dot > max_dot)
+        {
+            max_dot = cur_dot;
+            max_dot_idx = i;
+        }
+    }
+
+    return max_dot_idx;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+fwd_struct(Vec3);
+
+// Structure of arrays point data must be padded to a multiple of this,
+// using copies of a real point.
+#define MAX_DOT_SOA_PADDING 8
+
+// Index of the first point with the largest dot product against d.
+u32 max_dot_aos(const Vec3* points, u32 points_num, const Vec3& d);
+
+// Same as max_dot_aos, but over separate x, y and z arrays of
+// points_num_padded elements. Uses AVX2 or SSE2 when the build enables
+// them, scalar code otherwise.
+u32 max_dot_soa(const f32* xs, const f32* ys, const f32* zs, u32 points_num_padded, const Vec3& d);
\ No newline at end of file
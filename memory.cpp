@@ -5,6 +5,8 @@
 #include <stdlib.h>
 
 #ifdef ENABLE_MEMORY_TRACING
+    #include <pthread.h>
+
     struct AllocationCallstack 
     {
         char** callstack;
@@ -15,8 +17,13 @@
     #define MAX_ALLOC_CALLSTACKS 8096
     static AllocationCallstack alloc_callstacks[MAX_ALLOC_CALLSTACKS];
 
+    // Job workers allocate too, so the callstack table needs a lock.
+    static pthread_mutex_t alloc_callstacks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
     static void add_allocation_callstack(void* ptr)
     {
+        pthread_mutex_lock(&alloc_callstacks_mutex);
+
         for (u32 i = 0; i < MAX_ALLOC_CALLSTACKS; ++i)
         {
             if (alloc_callstacks[i].ptr == NULL)
@@ -30,7 +37,7 @@
                 };
 
                 alloc_callstacks[i] = ac;
-
+                pthread_mutex_unlock(&alloc_callstacks_mutex);
                 return;
             }
         }
@@ -40,6 +47,8 @@
 
     static void remove_allocation_callstack(void* ptr, bool must_be_present)
     {
+        pthread_mutex_lock(&alloc_callstacks_mutex);
+
         for (u32 i = 0; i < MAX_ALLOC_CALLSTACKS; ++i)
         {
             if (alloc_callstacks[i].ptr == ptr)
@@ -47,10 +56,13 @@
                 AllocationCallstack* ac = alloc_callstacks + i;
                 free(ac->callstack);
                 memzero(ac, sizeof(AllocationCallstack));
+                pthread_mutex_unlock(&alloc_callstacks_mutex);
                 return;
             }
         }
 
+        pthread_mutex_unlock(&alloc_callstacks_mutex);
+
         if (must_be_present)
             error("Tried to remove non-existing allocation callstack");
     }
@@ -111,7 +111,7 @@ static void skip_line(ParserState* ps)
 enum ParseMode
 {
     PARSE_MODE_ALL,
-    PARSE_MODE_ONLY_VERTICES
+    PARSE_MODE_VERTICES_AND_FACES
 };
 
 static ParsedData parse(char* data, unsigned data_size, ParseMode mode)
@@ -136,7 +136,7 @@ static ParsedData parse(char* data, unsigned data_size, ParseMode mode)
             parse_normal(&ps, &pd);
         else if (c == 'v' && ps.head + 1 < ps.end && (*(ps.head+1)) == ' ')
             parse_vertex(&ps, &pd);
-        else if (c == 'f' && mode == PARSE_MODE_ALL)
+        else if (c == 'f')
             parse_face(&ps, &pd);
         else
             skip_line(&ps);
@@ -240,16 +240,29 @@ ObjLoadVerticesResult obj_load_vertices(char* filename)
         return olr;
     }
 
-    ParsedData pd = parse((char*)flr.data, flr.data_size, PARSE_MODE_ONLY_VERTICES);
+    ParsedData pd = parse((char*)flr.data, flr.data_size, PARSE_MODE_VERTICES_AND_FACES);
     memf(flr.data);
 
+    u32 indices_num = da_num(pd.faces) * 3;
+    u32* indices = mema_tn(u32, indices_num);
+
+    for (u32 i = 0; i < da_num(pd.faces); ++i)
+    {
+        indices[i * 3] = pd.faces[i].v1;
+        indices[i * 3 + 1] = pd.faces[i].v2;
+        indices[i * 3 + 2] = pd.faces[i].v3;
+    }
+
     ObjLoadVerticesResult olr = {
         .ok = true,
         .vertices = (Vec3*)da_copy_data(pd.vertices),
-        .vertices_num = (u32)da_num(pd.vertices)
+        .indices = indices,
+        .vertices_num = (u32)da_num(pd.vertices),
+        .indices_num = indices_num
     };
 
     da_free(pd.vertices);
+    da_free(pd.faces);
 
     return olr;
 }
\ No newline at end of file
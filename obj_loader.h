@@ -11,7 +11,9 @@ struct ObjLoadVerticesResult
 {
     bool ok;
     Vec3* vertices;
+    u32* indices; // three per triangle, indexes vertices
     u32 vertices_num;
+    u32 indices_num;
 };
 
 ObjLoadResult obj_load(char* filename);
@@ -5,6 +5,7 @@
 #include "log.h"
 #include "time.h"
 #include "gjk_epa.h"
+#include "collide.h"
 #include "file.h"
 #include "jzon.h"
 #include "obj_loader.h"
@@ -12,13 +13,49 @@
 #include "dynamic_array.h"
 #include "debug.h"
 #include "render_resource.h"
+#include "max_dot.h"
+#include "jobs.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct Aabb
+{
+    Vec3 min;
+    Vec3 max;
+};
+
+// Convex piece of a mesh, only its hull vertices are kept.
+struct PhysicsHull
+{
+    Vec3* vertices;
+    u32 vertices_num;
+    u32* adjacency_offsets; // see GjkShape, NULL for small hulls
+    u32* adjacency;
+    f32* vertices_soa; // x, y and z blocks of vertices_soa_num each, only used without adjacency
+    u32 vertices_soa_num;
+};
+
+// Leaves hold triangles [first, first + num), inner nodes have num zero and
+// their children at first and first + 1.
+struct BvhNode
+{
+    Aabb bounds; // local space
+    u32 first;
+    u32 num;
+};
 
 struct PhysicsMesh
 {
     u32 idx;
     i64 namehash;
-    Vec3* vertices;
-    u32 vertices_num;
+    char* filename; // recordings refer to meshes by name
+    PhysicsHull* hulls; // one unless the mesh file asks for a convex decomposition
+    u32 hulls_num;
+    Vec3* triangles; // three vertices each, in BVH leaf order, for triangle mesh colliders
+    u32 triangles_num;
+    BvhNode* bvh; // root first
+    Vec3 bounds_center; // local space
+    Vec3 bounds_extents; // local space, half size
 };
 
 struct PhysicsState
@@ -35,8 +72,7 @@ struct PhysicsObject
     u32 rigidbody_idx;
     u32 render_object_idx;
     PhysicsMaterial material;
-    Vec3 pos;
-    Quat rot;
+    Aabb aabb; // world space, updated by broadphase
 };
 
 struct RecentCollision
@@ -52,9 +88,63 @@ struct Rigidbody
 {
     u32 idx;
     u32 object_idx;
-    Vec3 velocity;
-    Vec3 angular_velocity;
     f32 mass;
+    f32 inv_mass;
+    Vec3 inv_inertia; // diagonal of the inverse inertia tensor, in local space
+    u32 still_frames; // consecutive updates below sleep thresholds
+    u32 sleep_island_next; // ring through the rigidbodies of a sleeping island, they wake together
+    bool ccd;
+};
+
+#define MANIFOLD_MAX_POINTS 4
+
+struct ContactPoint
+{
+    Vec3 local_a; // on the rigidbody, in its local space
+    Vec3 local_b; // on the other object, in its local space
+    f32 normal_impulse; // accumulated by the solver, warm starts the next step
+    f32 tangent_impulses[2];
+};
+
+// Narrowphase finds one point per step, the manifold keeps the ones that are
+// still touching so resting shapes get supported at several points.
+struct ContactManifold
+{
+    Vec3 normal; // towards the rigidbody
+    ContactPoint points[MANIFOLD_MAX_POINTS];
+    u32 points_num;
+};
+
+// Candidate pair from broadphase, rigidbody is tested against object.
+struct PhysicsPair
+{
+    u32 rigidbody_idx;
+    u32 object_idx;
+    bool mirrored; // other half of a pair of two rigidbodies, only the first half is solved
+    GjkEpaCache cache; // carried over between updates while the pair stays in broadphase
+    ContactManifold manifold; // carried over like cache
+    GjkEpaSolution result; // written by narrowphase jobs
+};
+
+// One manifold point prepared for the solver. Index 0 of the per axis
+// arrays is the normal, 1 and 2 are the friction tangents.
+struct ContactConstraint
+{
+    ContactPoint* point;
+    u32 slot_a;
+    u32 slot_b;
+    f32 inv_mass_a;
+    f32 inv_mass_b;
+    Vec3 ra;
+    Vec3 rb;
+    Vec3 axes[3];
+    Vec3 angular_a[3]; // inverse inertia of a times ra x axis
+    Vec3 angular_b[3];
+    f32 effective_mass[3];
+    f32 target_velocity; // along normal, bounce or how fast a gap may close
+    f32 bias_target_velocity; // along normal, pushes out penetration
+    f32 bias_impulse;
+    f32 friction;
 };
 
 struct PhysicsWorld
@@ -63,272 +153,3157 @@ struct PhysicsWorld
     u32* objects_free_idx; // dynamic
     Rigidbody* rigidbodies; // dynamic
     u32* rigidbodies_free_idx; // dynamic
+
+    // Simulated state lives in dense arrays indexed by slot. Objects with a
+    // rigidbody occupy slots [0, rigidbody_slots_num) so integration and
+    // render syncing are straight passes over them.
+    u32* object_slots; // dynamic, object index -> slot
+    u32* slot_objects; // dynamic, slot -> object index
+    Vec3* positions; // dynamic
+    Quat* rotations; // dynamic
+    Vec3* prev_positions; // dynamic, before latest fixed step, for interpolation
+    Quat* prev_rotations; // dynamic
+    Vec3* velocities; // dynamic, zero for slots without rigidbody and for sleeping ones
+    Vec3* angular_velocities; // dynamic
+    Vec3* bias_velocities; // dynamic, penetration recovery of the latest step, not kept as momentum
+    Vec3* bias_angular_velocities; // dynamic
+    bool* sleeping; // dynamic
+    u32 rigidbody_slots_num;
+
+    u32* broadphase_sorted; // dynamic, object indices sorted on aabb.min.x
+    PhysicsPair* pairs; // dynamic, rebuilt each update
+    PhysicsPair* pairs_prev; // dynamic, pairs of previous update
+    ContactConstraint* contacts; // dynamic, rebuilt each step
+    GjkEpaStats* narrowphase_stats; // dynamic, one per narrowphase batch so jobs don't share counters
+    u32* island_parents; // dynamic, union-find over rigidbody indices, rebuilt each update
+    u32* island_still_frames; // dynamic, indexed by island root, rebuilt each update
+    u32* island_sleep_rings; // dynamic, indexed by island root, a rigidbody in the ring of an island falling asleep this update
+    PhysicsStats stats;
+    f32 fixed_dt; // zero means step once per update with time_dt()
+    u32 max_substeps;
+    u32 solver_iterations;
+    bool deterministic; // exactly one fixed step per update, time_dt() isn't used
+    bool recording;
+    u8* recording_data; // dynamic
+    bool* recorded_meshes; // dynamic, indexed by mesh, those already named in the recording
+    f32 accumulator; // time not yet simulated in fixed step mode
+    f32 interpolation_alpha; // how far between prev_pos and pos rendering should be
 };
 
 static PhysicsState ps = {};
 static bool inited = false;
 
-void physics_init()
+// Recordings are a header followed by events. Each event is its type and
+// payload size as u32 and then the payload, which is one of the Recorded*
+// structs below. Only u32 and f32 fields, so there is no padding to write.
+enum PhysicsRecordEvent
 {
-    check(!inited, "Trying to init physics twice");
-    inited = true;
-    ps.meshes_lut = idx_hash_map_create();
-    da_push(ps.meshes, PhysicsMesh{}); // dummy
-}
+    PHYSICS_RECORD_EVENT_LOAD_MESH, // u32 mesh index followed by the filename
+    PHYSICS_RECORD_EVENT_CREATE_OBJECT,
+    PHYSICS_RECORD_EVENT_CREATE_RIGIDBODY,
+    PHYSICS_RECORD_EVENT_SET_CCD,
+    PHYSICS_RECORD_EVENT_SET_VELOCITY,
+    PHYSICS_RECORD_EVENT_ADD_FORCE,
+    PHYSICS_RECORD_EVENT_ADD_TORQUE,
+    PHYSICS_RECORD_EVENT_SET_POSITION,
+    PHYSICS_RECORD_EVENT_SET_SOLVER_ITERATIONS,
+    PHYSICS_RECORD_EVENT_UPDATE // no payload
+};
 
-u32 physics_load_mesh(const char* filename)
+#define PHYSICS_RECORDING_MAGIC 0x43455250 // PREC
+#define PHYSICS_RECORDING_VERSION 1
+
+struct PhysicsRecordingHeader
 {
-    let filename_hash = str_hash(filename);
-    let existing = idx_hash_map_get(ps.meshes_lut, filename_hash);
+    u32 magic;
+    u32 version;
+    f32 fixed_dt;
+    u32 solver_iterations;
+};
 
-    if (existing)
-        return existing;
+// Indices are the ones the call returned or was given, replaying checks that
+// it gets the same ones back.
+struct RecordedObject
+{
+    u32 object_idx;
+    PhysicsCollider collider;
+    u32 render_object_idx;
+    Vec3 pos;
+    Quat rot;
+    PhysicsMaterial material;
+};
 
-    FileLoadResult flr = file_load(filename, FILE_LOAD_MODE_NULL_TERMINATED);
-    check(flr.ok, "Failed loading mesh from %s", filename);
-    JzonParseResult jpr = jzon_parse((char*)flr.data);
-    check(jpr.ok && jpr.output.is_table, "Outer object in %s isn't a table", filename);
-    memf(flr.data);
+struct RecordedRigidbody
+{
+    u32 rigidbody_idx;
+    u32 object_idx;
+    f32 mass;
+    Vec3 velocity;
+};
 
-    let jz_source = jzon_get(jpr.output, "source");
-    check(jz_source && jz_source->is_string, "%s doesn't contain source field", filename);
+struct RecordedValue
+{
+    u32 idx;
+    u32 value;
+};
 
-    let obj_vertices = obj_load_vertices(jz_source->string_val);
-    check(obj_vertices.ok, "Failed loading obj specified by %s in %s", jz_source->string_val, filename);
-    jzon_free(&jpr.output);
+struct RecordedVector
+{
+    u32 idx;
+    Vec3 v;
+};
 
-    check(obj_vertices.ok, "Failed loading mesh from file %s", filename);
+struct RecordedTorque
+{
+    u32 rigidbody_idx;
+    Vec3 pivot;
+    Vec3 point;
+    Vec3 force;
+};
 
-    let idx = da_num(ps.meshes_free_idx) > 0 ? da_pop(ps.meshes_free_idx) : da_num(ps.meshes);
-    PhysicsMesh m  = {
-        .idx = idx,
-        .namehash = filename_hash,
-        .vertices = obj_vertices.vertices,
-        .vertices_num = obj_vertices.vertices_num
-    };
-    da_insert(ps.meshes, m, idx);
-    idx_hash_map_add(ps.meshes_lut, filename_hash, idx);
-    return idx;
-}
+struct RecordedPosition
+{
+    u32 object_idx;
+    Vec3 pos;
+    Quat rot;
+};
 
-void physics_destroy_mesh(u32 mesh_idx)
+static void record_bytes(PhysicsWorld* w, const void* data, u32 size)
 {
-    let m = ps.meshes + mesh_idx;
-    memf(m->vertices);
-    idx_hash_map_remove(ps.meshes_lut, m->namehash);
-    memzero(m, sizeof(PhysicsMesh));
+    da_ensure_min_cap(w->recording_data, da_num(w->recording_data) + size);
+
+    for (u32 i = 0; i < size; ++i)
+        da_push(w->recording_data, ((const u8*)data)[i]);
 }
 
-u32 physics_create_rigidbody(PhysicsWorld* w, u32 object_idx,  f32 mass, const Vec3& velocity)
+static void record_event(PhysicsWorld* w, PhysicsRecordEvent type, const void* payload, u32 payload_size)
 {
-    check(mass > 0, "Mass must be in range (0, inf)");
-    let o = w->objects + object_idx;
-    check(!o->rigidbody_idx, "Trying to create rigidbody for physics object that already has one");
-    let idx = da_num(w->rigidbodies_free_idx) > 0 ? da_pop(w->rigidbodies_free_idx) : da_num(w->rigidbodies);
-
-    Rigidbody r = {
-        .idx = idx,
-        .mass = mass,
-        .object_idx = object_idx,
-        .velocity = velocity
-    };
+    if (!w->recording)
+        return;
 
-    o->rigidbody_idx = idx;
-    da_insert(w->rigidbodies, r, idx);
-    return idx;
+    u32 event_header[] = {(u32)type, payload_size};
+    record_bytes(w, event_header, sizeof(event_header));
+    record_bytes(w, payload, payload_size);
 }
 
-void physics_set_velocity(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& vel)
+void physics_init()
 {
-    let rb = w->rigidbodies + rigidbody_idx;
-    rb->velocity = vel;
+    check(!inited, "Trying to init physics twice");
+    inited = true;
+    ps.meshes_lut = idx_hash_map_create();
+    da_push(ps.meshes, PhysicsMesh{}); // dummy
 }
 
-void physics_add_force(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& f)
+// Below this many vertices a linear support scan beats hill climbing.
+#define HILL_CLIMB_MIN_VERTICES 32
+// Points closer than this to the hull, relative to mesh size, are inside it.
+#define HULL_TOLERANCE 0.00001f
+
+struct HullFace
 {
-    let rb = w->rigidbodies + rigidbody_idx;
-    let acc = f/rb->mass;
-    rb->velocity += acc;
+    u32 v[3]; // counter clockwise seen from outside
+    Vec3 normal;
+    f32 dist;
+};
+
+static HullFace make_hull_face(const Vec3* points, u32 a, u32 b, u32 c)
+{
+    let n = normalize(cross(points[b] - points[a], points[c] - points[a]));
+    return {.v = {a, b, c}, .normal = n, .dist = dot(n, points[a])};
 }
 
-void physics_add_torque(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& pivot, const Vec3& point, const Vec3& force)
+static u32 farthest_point(const Vec3* points, u32 points_num, const Vec3& dir)
 {
-    let rb = w->rigidbodies + rigidbody_idx;
+    u32 best = 0;
 
-    // add moment of inertia
+    for (u32 i = 1; i < points_num; ++i)
+        if (dot(points[i], dir) > dot(points[best], dir))
+            best = i;
 
-    let arm = point - pivot;
-    let larm = len(arm);
-    rb->angular_velocity += cross(arm, force) * (1/(larm * larm * rb->mass));
+    return best;
 }
 
-PhysicsCollider physics_create_collider(u32 mesh_idx)
+// Incremental convex hull. Returns the triangles of it, indexing points, or
+// NULL if the points are flat or all the same. Duplicated and interior points
+// end up in no triangle.
+static HullFace* compute_convex_hull(const Vec3* points, u32 points_num)
 {
-    return { .mesh_idx = mesh_idx };
-}
+    if (points_num < 4)
+        return NULL;
 
-PhysicsWorld* physics_create_world()
-{
-    let w = mema_zero_t(PhysicsWorld);
-    da_push(w->objects, PhysicsObject{}); // zero-dummy
-    da_push(w->rigidbodies, Rigidbody{}); // zero-dummy
-    return w;
-}
+    Vec3 bmin = points[0];
+    Vec3 bmax = points[0];
 
-u32 physics_create_object(PhysicsWorld* w, const PhysicsCollider& collider, u32 render_object_idx, const Vec3& pos, const Quat& rot, const PhysicsMaterial& pm)
-{
-    let idx = da_num(w->objects_free_idx) > 0 ? da_pop(w->objects_free_idx) : da_num(w->objects);
+    for (u32 i = 1; i < points_num; ++i)
+    {
+        bmin = {fminf(bmin.x, points[i].x), fminf(bmin.y, points[i].y), fminf(bmin.z, points[i].z)};
+        bmax = {fmaxf(bmax.x, points[i].x), fmaxf(bmax.y, points[i].y), fmaxf(bmax.z, points[i].z)};
+    }
 
-    PhysicsObject o = {
-        .idx = idx,
-        .collider = collider,
-        .pos = pos,
-        .rot = rot,
-        .render_object_idx = render_object_idx,
-        .material = pm
-    };
+    let eps = HULL_TOLERANCE * len(bmax - bmin);
 
-    da_insert(w->objects, o, idx);
-    return idx;
-}
+    // Starting tetrahedron: the longest of the axis spans, the point farthest
+    // from that line and then the one farthest from their plane.
+    Vec3 axes[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    u32 i0 = 0;
+    u32 i1 = 0;
 
-void physics_set_position(PhysicsWorld* w, u32 object_idx, const Vec3& pos, const Quat& rot)
-{
-    let o = w->objects + object_idx;
-    o->pos = pos;
-    o->rot = rot;
-}
+    for (u32 a = 0; a < 3; ++a)
+    {
+        let lo = farthest_point(points, points_num, -axes[a]);
+        let hi = farthest_point(points, points_num, axes[a]);
 
-void physics_update_world(PhysicsWorld* w)
-{
-    float dt = time_dt();
-    //float t = time_since_start();
+        if (len(points[hi] - points[lo]) > len(points[i1] - points[i0]))
+        {
+            i0 = lo;
+            i1 = hi;
+        }
+    }
 
-    da_foreach(rb, w->rigidbodies)
+    let line_dir = normalize(points[i1] - points[i0]);
+    u32 i2 = i0;
+    f32 i2_dist = 0;
+
+    for (u32 i = 0; i < points_num; ++i)
     {
-        if (!rb->idx)
-            continue;
+        let d = points[i] - points[i0];
+        let dist = len(d - line_dir * dot(d, line_dir));
 
-        let rb_idx = arr_idx(rb, w->rigidbodies);
+        if (dist > i2_dist)
+        {
+            i2 = i;
+            i2_dist = dist;
+        }
+    }
 
-        // Update rigidbody state.
-        Vec3 g = {0, 0, -9.82f};
+    if (i2_dist <= eps)
+        return NULL;
 
-        physics_add_force(w, rb_idx, g * rb->mass * dt);
-        let wo = w->objects + rb->object_idx;
+    let plane_n = normalize(cross(points[i1] - points[i0], points[i2] - points[i0]));
+    u32 i3 = i0;
+    f32 i3_dist = 0;
+
+    for (u32 i = 0; i < points_num; ++i)
+    {
+        let dist = fabsf(dot(plane_n, points[i] - points[i0]));
 
-        da_foreach(wo_colliding_with, w->objects)
+        if (dist > i3_dist)
         {
-            let wo_colliding_with_idx = arr_idx(wo_colliding_with, w->objects);
+            i3 = i;
+            i3_dist = dist;
+        }
+    }
 
-            if (wo_colliding_with_idx == rb->object_idx || !wo_colliding_with->idx)
-                continue;
+    if (i3_dist <= eps)
+        return NULL;
 
-            // TODO: cache the shapes etc
+    let center = (points[i0] + points[i1] + points[i2] + points[i3]) * 0.25f;
+    u32 tetrahedron[][3] = {{i0, i1, i2}, {i0, i3, i1}, {i1, i3, i2}, {i2, i3, i0}};
+    HullFace* faces = NULL; // dynamic
 
-            let c1 = wo->collider;
-            let p1 = wo->pos;
-            let r1 = wo->rot;
-            let m1 = ps.meshes + c1.mesh_idx;
+    for (u32 i = 0; i < 4; ++i)
+    {
+        let t = tetrahedron[i];
+        let f = make_hull_face(points, t[0], t[1], t[2]);
+        da_push(faces, dot(f.normal, center) > f.dist ? make_hull_face(points, t[0], t[2], t[1]) : f);
+    }
 
-            GjkShape s1 = {
-                .vertices = mema_tn(Vec3, m1->vertices_num),
-                .vertices_num = m1->vertices_num
-            };
+    u32* visible = NULL; // dynamic, face indices in ascending order
+    u32* horizon = NULL; // dynamic, edge pairs
 
-            for (u32 vi = 0; vi < s1.vertices_num; ++vi)
-                s1.vertices[vi] = rotate_vec3(r1, m1->vertices[vi]) + p1;
+    for (u32 pi = 0; pi < points_num; ++pi)
+    {
+        let p = points[pi];
+        da_clear(visible);
 
-            let c2 = wo_colliding_with->collider;
-            let p2 = wo_colliding_with->pos;
-            let r2 = wo_colliding_with->rot;
-            let m2 = ps.meshes + c2.mesh_idx;
+        for (u32 fi = 0; fi < da_num(faces); ++fi)
+            if (dot(faces[fi].normal, p) - faces[fi].dist > eps)
+                da_push(visible, fi);
 
-            GjkShape s2 = {
-                .vertices = mema_tn(Vec3, m2->vertices_num),
-                .vertices_num = m2->vertices_num
-            };
+        if (da_num(visible) == 0)
+            continue;
 
-            for (u32 vi = 0; vi < s2.vertices_num; ++vi)
-                s2.vertices[vi] = rotate_vec3(r2, m2->vertices[vi]) + p2;
+        // Edges of visible faces that no other visible face shares, in the
+        // same winding, outline the hole the point gets connected to.
+        da_clear(horizon);
 
-            let coll = gjk_epa_intersect_and_solve(s1, s2);
+        da_foreach(vi, visible)
+        {
+            let f = faces + *vi;
 
-            if (coll.colliding)
+            for (u32 e = 0; e < 3; ++e)
             {
-                let sol = coll.solution;
-                wo->pos += sol;
-                let m = rb->mass;
-                let vel = rb->velocity;
-                let avel = rb->angular_velocity;
-                let r = wo->pos - coll.contact_point;
-                let vel_cp = vel + cross(avel, r);
-
-                #define SOLUTION_THRES 0.0001f
-                if (dot(vel_cp, sol) < 0 && len(sol) > SOLUTION_THRES)
+                let a = f->v[e];
+                let b = f->v[(e + 1) % 3];
+                bool shared = false;
+
+                da_foreach(vj, visible)
+                {
+                    let g = faces + *vj;
+
+                    for (u32 ge = 0; ge < 3; ++ge)
+                        if (g->v[ge] == b && g->v[(ge + 1) % 3] == a)
+                            shared = true;
+                }
+
+                if (!shared)
                 {
-                    let n = normalize(sol);
-                    let vel_cp_normal = project(vel_cp, n);
-                    let vel_in_surface_dir = vel_cp - vel_cp_normal;
-                    let friction = fmin(wo->material.friction + wo_colliding_with->material.friction, 1);
+                    da_push(horizon, a);
+                    da_push(horizon, b);
+                }
+            }
+        }
 
-                    let normal_f = -m*vel_cp_normal;
-                    let friction_f = -(len(m*g*dt)*friction*vel_in_surface_dir);
+        // Descending, so whatever gets moved into a removed face is not visible.
+        for (u32 vi = da_num(visible); vi-- > 0;)
+        {
+            faces[visible[vi]] = da_last(faces);
+            (void)da_pop(faces);
+        }
 
-                    let f = normal_f + friction_f;
+        for (u32 hi = 0; hi < da_num(horizon); hi += 2)
+            da_push(faces, make_hull_face(points, horizon[hi], horizon[hi + 1], pi));
+    }
 
-                    Vec3 verts[] = {coll.contact_point, wo->pos, wo->pos - f};
-                    Vec4 colors[] = {vec4_red, vec4_green, vec4_green};
-                    debug_draw(verts, 3, colors, PRIMITIVE_TOPOLOGY_LINE_STRIP);
+    da_free(visible);
+    da_free(horizon);
+    return faces;
+}
 
+static int u64_compare(const void* a, const void* b)
+{
+    let ua = *(const u64*)a;
+    let ub = *(const u64*)b;
+    return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
 
-                    physics_add_force(w, rb_idx, f);
-                    let lr = len(r);
-                    let t = -cross(r, normal_f) / (lr * lr * rb->mass);
-                    //let t_friction = project(cross(rb->angular_velocity, r), cross(normal_f, r));
-                    //rb->angular_velocity = rb->angular_velocity*0.1 + t;
-                    //physics_add_torque(w, rigidbody_idx, wo->pos, coll.contact_point, t);
-                    //rb->angular_velocity = t;
-                    (void)t;
-                }
-            }
+// Builds the vertex graph of the hull triangles for hill climbing support.
+static void build_adjacency(PhysicsHull* h, HullFace* faces)
+{
+    u64* edges = NULL; // dynamic, from << 32 | to
 
-            memf(s1.vertices);
-            memf(s2.vertices);
+    da_foreach(f, faces)
+    {
+        for (u32 c = 0; c < 3; ++c)
+        {
+            u64 from = f->v[c];
+            u64 to = f->v[(c + 1) % 3];
+            da_push(edges, from << 32 | to);
+            da_push(edges, to << 32 | from);
         }
+    }
+
+    qsort(edges, da_num(edges), sizeof(u64), u64_compare);
+    let offsets_num = h->vertices_num + 1;
+    h->adjacency_offsets = mema_zero_tn(u32, offsets_num);
+    h->adjacency = mema_tn(u32, da_num(edges));
+    u32 adjacency_num = 0;
+
+    for (u32 i = 0; i < da_num(edges); ++i)
+    {
+        if (i > 0 && edges[i] == edges[i - 1])
+            continue;
 
-        // Move rigidbody according to velocties
-        wo->pos += rb->velocity * dt;
-        wo->rot *= quat_from_axis_angle(rb->angular_velocity, dt);
+        h->adjacency[adjacency_num++] = (u32)edges[i];
+        ++h->adjacency_offsets[(edges[i] >> 32) + 1];
     }
+
+    for (u32 i = 0; i < h->vertices_num; ++i)
+        h->adjacency_offsets[i + 1] += h->adjacency_offsets[i];
+
+    da_free(edges);
 }
 
-void physics_destroy_world(PhysicsWorld* w)
+// Boxes and other tiny meshes are faster with the plain Vec3 scan, see bench_support.cpp.
+#define SOA_MIN_VERTICES 16
+
+static void build_vertices_soa(PhysicsHull* h)
 {
-    da_free(w->objects);
-    da_free(w->objects_free_idx);
-    da_free(w->rigidbodies);
-    da_free(w->rigidbodies_free_idx);
-    memf(w);
+    let n = h->vertices_num;
+    let padded_n = ((n + MAX_DOT_SOA_PADDING - 1) / MAX_DOT_SOA_PADDING) * MAX_DOT_SOA_PADDING;
+    h->vertices_soa = mema_tn(f32, padded_n * 3);
+    h->vertices_soa_num = padded_n;
+
+    for (u32 i = 0; i < padded_n; ++i)
+    {
+        let v = h->vertices[i < n ? i : 0];
+        h->vertices_soa[i] = v.x;
+        h->vertices_soa[padded_n + i] = v.y;
+        h->vertices_soa[padded_n * 2 + i] = v.z;
+    }
 }
 
-void physics_shutdown()
+// Keeps only the hull vertices of points. Flat point sets have no hull, they
+// keep all distinct points instead.
+static PhysicsHull create_hull(const Vec3* points, u32 points_num)
 {
-    for (u32 i = 0; i < da_num(ps.meshes); ++i)
-        if (ps.meshes[i].idx)
-            physics_destroy_mesh(i);
+    PhysicsHull h = {};
+    let faces = compute_convex_hull(points, points_num);
+    Vec3* vertices = NULL; // dynamic
 
-    da_free(ps.meshes);
-    da_free(ps.meshes_free_idx);
-    idx_hash_map_destroy(ps.meshes_lut);
+    if (faces)
+    {
+        let remap = mema_tn(u32, points_num);
+
+        for (u32 i = 0; i < points_num; ++i)
+            remap[i] = (u32)-1;
+
+        da_foreach(f, faces)
+        {
+            for (u32 c = 0; c < 3; ++c)
+            {
+                if (remap[f->v[c]] == (u32)-1)
+                {
+                    remap[f->v[c]] = da_num(vertices);
+                    da_push(vertices, points[f->v[c]]);
+                }
+
+                f->v[c] = remap[f->v[c]];
+            }
+        }
+
+        memf(remap);
+    }
+    else
+    {
+        for (u32 i = 0; i < points_num; ++i)
+        {
+            bool duplicate = false;
+
+            da_foreach(v, vertices)
+                if (almost_eql(*v, points[i]))
+                    duplicate = true;
+
+            if (!duplicate)
+                da_push(vertices, points[i]);
+        }
+    }
+
+    h.vertices = (Vec3*)da_copy_data(vertices);
+    h.vertices_num = da_num(vertices);
+    da_free(vertices);
+
+    if (faces && h.vertices_num >= HILL_CLIMB_MIN_VERTICES)
+        build_adjacency(&h, faces);
+    else if (h.vertices_num >= SOA_MIN_VERTICES)
+        build_vertices_soa(&h);
+
+    da_free(faces);
+    return h;
 }
 
-const Vec3& physics_get_position(PhysicsWorld* w, u32 object_idx)
+static void destroy_hull(PhysicsHull* h)
 {
-    return w->objects[object_idx].pos;
+    memf(h->vertices);
+    memf(h->adjacency_offsets);
+    memf(h->adjacency);
+    memf(h->vertices_soa);
 }
 
-const Quat& physics_get_rotation(PhysicsWorld* w, u32 object_idx)
+// Decomposition stops once every part is less concave than this, relative to mesh size.
+#define DECOMPOSITION_MAX_CONCAVITY 0.02f
+
+struct DecompositionPart
+{
+    u32* triangles; // dynamic, index of first index of each triangle
+    f32 concavity;
+};
+
+static Vec3* part_points(const Vec3* vertices, const u32* indices, u32* triangles)
 {
-    return w->objects[object_idx].rot;
+    Vec3* points = NULL; // dynamic
+
+    da_foreach(t, triangles)
+        for (u32 c = 0; c < 3; ++c)
+            da_push(points, vertices[indices[*t + c]]);
+
+    return points;
+}
+
+// How far the triangles of a part are from the surface of its hull, zero if
+// the part is convex.
+static f32 part_concavity(const Vec3* vertices, const u32* indices, u32* triangles)
+{
+    let points = part_points(vertices, indices, triangles);
+    let faces = compute_convex_hull(points, da_num(points));
+    f32 concavity = 0;
+
+    if (faces)
+    {
+        for (u32 i = 0; i < da_num(points); i += 3)
+        {
+            let centroid = (points[i] + points[i + 1] + points[i + 2]) * (1.0f / 3.0f);
+            f32 depth = faces[0].dist - dot(faces[0].normal, centroid);
+
+            da_foreach(f, faces)
+                depth = fminf(depth, f->dist - dot(f->normal, centroid));
+
+            concavity = fmaxf(concavity, depth);
+        }
+    }
+
+    da_free(faces);
+    da_free(points);
+    return concavity;
+}
+
+static f32 axis_value(const Vec3& v, u32 axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static f32 triangle_centroid(const Vec3* vertices, const u32* indices, u32 t, u32 axis)
+{
+    return axis_value((vertices[indices[t]] + vertices[indices[t + 1]] + vertices[indices[t + 2]]) * (1.0f / 3.0f), axis);
+}
+
+// Splits the most concave part in two with an axis aligned plane, trying a
+// few planes through its triangle centroids and keeping the split with the
+// least concave halves. Triangles go whole to the side of their centroid, so
+// the hulls of the parts still cover the whole surface.
+static bool split_part(const Vec3* vertices, const u32* indices, DecompositionPart* part, DecompositionPart* new_part)
+{
+    DecompositionPart best[2] = {};
+    f32 best_score = 0;
+    bool found = false;
+    u32* sides[2] = {};
+
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+        f32 cmin = triangle_centroid(vertices, indices, part->triangles[0], axis);
+        f32 cmax = cmin;
+
+        da_foreach(t, part->triangles)
+        {
+            let c = triangle_centroid(vertices, indices, *t, axis);
+            cmin = fminf(cmin, c);
+            cmax = fmaxf(cmax, c);
+        }
+
+        for (u32 k = 1; k < 4; ++k)
+        {
+            let split = cmin + (cmax - cmin) * k * 0.25f;
+            da_clear(sides[0]);
+            da_clear(sides[1]);
+
+            da_foreach(t, part->triangles)
+                da_push(sides[triangle_centroid(vertices, indices, *t, axis) < split ? 0 : 1], *t);
+
+            if (da_num(sides[0]) == 0 || da_num(sides[1]) == 0)
+                continue;
+
+            let c0 = part_concavity(vertices, indices, sides[0]);
+            let c1 = part_concavity(vertices, indices, sides[1]);
+            let score = fmaxf(c0, c1);
+
+            if (found && score >= best_score)
+                continue;
+
+            found = true;
+            best_score = score;
+
+            for (u32 s = 0; s < 2; ++s)
+            {
+                da_clear(best[s].triangles);
+
+                da_foreach(t, sides[s])
+                    da_push(best[s].triangles, *t);
+            }
+
+            best[0].concavity = c0;
+            best[1].concavity = c1;
+        }
+    }
+
+    da_free(sides[0]);
+    da_free(sides[1]);
+
+    if (!found)
+        return false;
+
+    da_free(part->triangles);
+    *part = best[0];
+    *new_part = best[1];
+    return true;
+}
+
+// Convex hull of the mesh, or with max_hulls above one an approximate
+// convex decomposition into at most that many hulls.
+static PhysicsHull* create_hulls(const Vec3* vertices, u32 vertices_num, const u32* indices, u32 indices_num, u32 max_hulls, f32 mesh_size, u32* hulls_num)
+{
+    DecompositionPart* parts = NULL; // dynamic
+
+    if (max_hulls > 1 && indices_num > 0)
+    {
+        DecompositionPart whole = {};
+
+        for (u32 t = 0; t < indices_num; t += 3)
+            da_push(whole.triangles, t);
+
+        whole.concavity = part_concavity(vertices, indices, whole.triangles);
+        da_push(parts, whole);
+
+        while (da_num(parts) < max_hulls)
+        {
+            u32 most_concave = 0;
+
+            for (u32 i = 1; i < da_num(parts); ++i)
+                if (parts[i].concavity > parts[most_concave].concavity)
+                    most_concave = i;
+
+            if (parts[most_concave].concavity <= DECOMPOSITION_MAX_CONCAVITY * mesh_size)
+                break;
+
+            DecompositionPart new_part = {};
+
+            if (split_part(vertices, indices, parts + most_concave, &new_part))
+                da_push(parts, new_part);
+            else
+                parts[most_concave].concavity = 0;
+        }
+    }
+
+    if (da_num(parts) <= 1)
+    {
+        if (parts)
+            da_free(parts[0].triangles);
+
+        da_free(parts);
+        *hulls_num = 1;
+        let hulls = mema_tn(PhysicsHull, 1);
+        hulls[0] = create_hull(vertices, vertices_num);
+        return hulls;
+    }
+
+    *hulls_num = da_num(parts);
+    let hulls = mema_tn(PhysicsHull, da_num(parts));
+
+    for (u32 i = 0; i < da_num(parts); ++i)
+    {
+        let points = part_points(vertices, indices, parts[i].triangles);
+        hulls[i] = create_hull(points, da_num(points));
+        da_free(points);
+        da_free(parts[i].triangles);
+    }
+
+    da_free(parts);
+    return hulls;
+}
+
+#define BVH_LEAF_TRIANGLES 4
+
+static Aabb triangle_bounds(const Vec3* t)
+{
+    return {
+        .min = {fminf(t[0].x, fminf(t[1].x, t[2].x)), fminf(t[0].y, fminf(t[1].y, t[2].y)), fminf(t[0].z, fminf(t[1].z, t[2].z))},
+        .max = {fmaxf(t[0].x, fmaxf(t[1].x, t[2].x)), fmaxf(t[0].y, fmaxf(t[1].y, t[2].y)), fmaxf(t[0].z, fmaxf(t[1].z, t[2].z))}
+    };
+}
+
+static Vec3 triangle_center(const Vec3* t)
+{
+    return (t[0] + t[1] + t[2]) * (1.0f / 3.0f);
+}
+
+static Aabb aabb_merge(const Aabb& a, const Aabb& b)
+{
+    return {
+        .min = {fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y), fminf(a.min.z, b.min.z)},
+        .max = {fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y), fmaxf(a.max.z, b.max.z)}
+    };
+}
+
+// Splits triangles at the middle of the longest axis of their centroids,
+// reordering them so each node's triangles are contiguous.
+static void build_bvh_node(Vec3* triangles, BvhNode** nodes, u32 node_idx, u32 first, u32 num)
+{
+    let first_centroid = triangle_center(triangles + first * 3);
+    Aabb bounds = triangle_bounds(triangles + first * 3);
+    Aabb centroid_bounds = {.min = first_centroid, .max = first_centroid};
+
+    for (u32 i = first + 1; i < first + num; ++i)
+    {
+        let c = triangle_center(triangles + i * 3);
+        bounds = aabb_merge(bounds, triangle_bounds(triangles + i * 3));
+        centroid_bounds = aabb_merge(centroid_bounds, {.min = c, .max = c});
+    }
+
+    (*nodes)[node_idx] = {.bounds = bounds, .first = first, .num = num};
+
+    if (num <= BVH_LEAF_TRIANGLES)
+        return;
+
+    let size = centroid_bounds.max - centroid_bounds.min;
+    let axis = size.x > size.y ? (size.x > size.z ? 0u : 2u) : (size.y > size.z ? 1u : 2u);
+    let split = axis_value(centroid_bounds.min + size * 0.5f, axis);
+    u32 mid = first;
+
+    for (u32 i = first; i < first + num; ++i)
+    {
+        if (axis_value(triangle_center(triangles + i * 3), axis) < split)
+        {
+            for (u32 c = 0; c < 3; ++c)
+            {
+                let t = triangles[i * 3 + c];
+                triangles[i * 3 + c] = triangles[mid * 3 + c];
+                triangles[mid * 3 + c] = t;
+            }
+
+            ++mid;
+        }
+    }
+
+    // All centroids in one spot, any split is as good.
+    if (mid == first || mid == first + num)
+        mid = first + num / 2;
+
+    let children = da_num(*nodes);
+    da_push(*nodes, BvhNode{});
+    da_push(*nodes, BvhNode{});
+    (*nodes)[node_idx] = {.bounds = bounds, .first = children, .num = 0};
+    build_bvh_node(triangles, nodes, children, first, mid - first);
+    build_bvh_node(triangles, nodes, children + 1, mid, first + num - mid);
+}
+
+static void build_bvh(PhysicsMesh* m, const Vec3* vertices, const u32* indices, u32 indices_num)
+{
+    if (indices_num < 3)
+        return;
+
+    m->triangles_num = indices_num / 3;
+    let triangle_vertices_num = m->triangles_num * 3;
+    m->triangles = mema_tn(Vec3, triangle_vertices_num);
+
+    for (u32 i = 0; i < triangle_vertices_num; ++i)
+        m->triangles[i] = vertices[indices[i]];
+
+    BvhNode* nodes = NULL; // dynamic
+    da_push(nodes, BvhNode{});
+    build_bvh_node(m->triangles, &nodes, 0, 0, m->triangles_num);
+    m->bvh = (BvhNode*)da_copy_data(nodes);
+    da_free(nodes);
+}
+
+u32 physics_load_mesh(const char* filename)
+{
+    let filename_hash = str_hash(filename);
+    let existing = idx_hash_map_get(ps.meshes_lut, filename_hash);
+
+    if (existing)
+        return existing;
+
+    FileLoadResult flr = file_load(filename, FILE_LOAD_MODE_NULL_TERMINATED);
+    check(flr.ok, "Failed loading mesh from %s", filename);
+    JzonParseResult jpr = jzon_parse((char*)flr.data);
+    check(jpr.ok && jpr.output.is_table, "Outer object in %s isn't a table", filename);
+    memf(flr.data);
+
+    let jz_source = jzon_get(jpr.output, "source");
+    check(jz_source && jz_source->is_string, "%s doesn't contain source field", filename);
+
+    // Optional, concave meshes can set this to collide as several hulls.
+    let jz_max_hulls = jzon_get(jpr.output, "max_convex_hulls");
+    u32 max_hulls = (jz_max_hulls && jz_max_hulls->is_int && jz_max_hulls->int_val > 1) ? (u32)jz_max_hulls->int_val : 1;
+
+    let obj_vertices = obj_load_vertices(jz_source->string_val);
+    check(obj_vertices.ok, "Failed loading obj specified by %s in %s", jz_source->string_val, filename);
+    jzon_free(&jpr.output);
+
+    check(obj_vertices.ok, "Failed loading mesh from file %s", filename);
+    check(obj_vertices.vertices_num > 0, "Mesh %s has no vertices", filename);
+
+    Vec3 bmin = obj_vertices.vertices[0];
+    Vec3 bmax = obj_vertices.vertices[0];
+
+    for (u32 vi = 1; vi < obj_vertices.vertices_num; ++vi)
+    {
+        let v = obj_vertices.vertices[vi];
+        bmin = {fminf(bmin.x, v.x), fminf(bmin.y, v.y), fminf(bmin.z, v.z)};
+        bmax = {fmaxf(bmax.x, v.x), fmaxf(bmax.y, v.y), fmaxf(bmax.z, v.z)};
+    }
+
+    let idx = da_num(ps.meshes_free_idx) > 0 ? da_pop(ps.meshes_free_idx) : da_num(ps.meshes);
+    PhysicsMesh m  = {
+        .idx = idx,
+        .namehash = filename_hash,
+        .filename = str_copy(filename),
+        .bounds_center = (bmin + bmax) * 0.5f,
+        .bounds_extents = (bmax - bmin) * 0.5f
+    };
+
+    m.hulls = create_hulls(obj_vertices.vertices, obj_vertices.vertices_num, obj_vertices.indices, obj_vertices.indices_num, max_hulls, len(bmax - bmin), &m.hulls_num);
+    build_bvh(&m, obj_vertices.vertices, obj_vertices.indices, obj_vertices.indices_num);
+    memf(obj_vertices.vertices);
+    memf(obj_vertices.indices);
+    da_insert(ps.meshes, m, idx);
+    idx_hash_map_add(ps.meshes_lut, filename_hash, idx);
+    return idx;
+}
+
+void physics_destroy_mesh(u32 mesh_idx)
+{
+    let m = ps.meshes + mesh_idx;
+
+    for (u32 i = 0; i < m->hulls_num; ++i)
+        destroy_hull(m->hulls + i);
+
+    memf(m->hulls);
+    memf(m->triangles);
+    memf(m->bvh);
+    memf(m->filename);
+    idx_hash_map_remove(ps.meshes_lut, m->namehash);
+    memzero(m, sizeof(PhysicsMesh));
+}
+
+template<typename T> static void swap_elements(T* a, u32 i, u32 j)
+{
+    let t = a[i];
+    a[i] = a[j];
+    a[j] = t;
+}
+
+static void swap_slots(PhysicsWorld* w, u32 a, u32 b)
+{
+    if (a == b)
+        return;
+
+    swap_elements(w->slot_objects, a, b);
+    swap_elements(w->positions, a, b);
+    swap_elements(w->rotations, a, b);
+    swap_elements(w->prev_positions, a, b);
+    swap_elements(w->prev_rotations, a, b);
+    swap_elements(w->velocities, a, b);
+    swap_elements(w->angular_velocities, a, b);
+    swap_elements(w->sleeping, a, b);
+    w->object_slots[w->slot_objects[a]] = a;
+    w->object_slots[w->slot_objects[b]] = b;
+}
+
+static u32 rigidbody_slot(const PhysicsWorld* w, u32 rigidbody_idx)
+{
+    return w->object_slots[w->rigidbodies[rigidbody_idx].object_idx];
+}
+
+static void collider_local_bounds(const PhysicsCollider& c, Vec3* center, Vec3* extents);
+
+// Spheres are exact, everything else uses the solid box of its local bounds.
+static Vec3 calc_inv_inertia(const PhysicsCollider& c, f32 mass)
+{
+    if (c.type == PHYSICS_COLLIDER_TYPE_SPHERE)
+    {
+        let i = 2.5f / (mass * c.radius * c.radius);
+        return {i, i, i};
+    }
+
+    Vec3 center, e;
+    collider_local_bounds(c, &center, &e);
+
+    return {
+        3 / (mass * (e.y * e.y + e.z * e.z)),
+        3 / (mass * (e.x * e.x + e.z * e.z)),
+        3 / (mass * (e.x * e.x + e.y * e.y))
+    };
+}
+
+u32 physics_create_rigidbody(PhysicsWorld* w, u32 object_idx,  f32 mass, const Vec3& velocity)
+{
+    check(mass > 0, "Mass must be in range (0, inf)");
+    let o = w->objects + object_idx;
+    check(!o->rigidbody_idx, "Trying to create rigidbody for physics object that already has one");
+    check(o->collider.type != PHYSICS_COLLIDER_TYPE_PLANE, "Planes can't have rigidbodies");
+    check(o->collider.type != PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH, "Triangle meshes can't have rigidbodies");
+    let idx = da_num(w->rigidbodies_free_idx) > 0 ? da_pop(w->rigidbodies_free_idx) : da_num(w->rigidbodies);
+
+    Rigidbody r = {
+        .idx = idx,
+        .object_idx = object_idx,
+        .mass = mass,
+        .inv_mass = 1 / mass,
+        .inv_inertia = calc_inv_inertia(o->collider, mass)
+    };
+
+    RecordedRigidbody rr = {
+        .rigidbody_idx = idx,
+        .object_idx = object_idx,
+        .mass = mass,
+        .velocity = velocity
+    };
+
+    record_event(w, PHYSICS_RECORD_EVENT_CREATE_RIGIDBODY, &rr, sizeof(rr));
+    o->rigidbody_idx = idx;
+    da_insert(w->rigidbodies, r, idx);
+
+    // Move the object into the rigidbody part of the slots.
+    let slot = w->rigidbody_slots_num++;
+    swap_slots(w, w->object_slots[object_idx], slot);
+    w->velocities[slot] = velocity;
+    return idx;
+}
+
+// Wakes the rigidbody and everything that went to sleep in the same island.
+static void wake_rigidbody(PhysicsWorld* w, u32 rigidbody_idx)
+{
+    let rb = w->rigidbodies + rigidbody_idx;
+    rb->still_frames = 0;
+
+    if (!w->sleeping[rigidbody_slot(w, rigidbody_idx)])
+        return;
+
+    // Only walks the island's own ring, waking stays cheap with many islands asleep.
+    let cur = rigidbody_idx;
+
+    do
+    {
+        let other = w->rigidbodies + cur;
+        w->sleeping[w->object_slots[other->object_idx]] = false;
+        other->still_frames = 0;
+        cur = other->sleep_island_next;
+        other->sleep_island_next = 0;
+    } while (cur != rigidbody_idx);
+}
+
+static void apply_force(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& f)
+{
+    let acc = f/w->rigidbodies[rigidbody_idx].mass;
+    w->velocities[rigidbody_slot(w, rigidbody_idx)] += acc;
+}
+
+// World space inverse inertia tensor times v.
+static Vec3 apply_inv_inertia(const Vec3& inv_inertia, const Quat& rot, const Vec3& v)
+{
+    let l = rotate_vec3(inverse(rot), v);
+    return rotate_vec3(rot, {l.x * inv_inertia.x, l.y * inv_inertia.y, l.z * inv_inertia.z});
+}
+
+void physics_set_ccd(PhysicsWorld* w, u32 rigidbody_idx, bool enabled)
+{
+    RecordedValue rv = {.idx = rigidbody_idx, .value = enabled};
+    record_event(w, PHYSICS_RECORD_EVENT_SET_CCD, &rv, sizeof(rv));
+    w->rigidbodies[rigidbody_idx].ccd = enabled;
+}
+
+void physics_set_velocity(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& vel)
+{
+    RecordedVector rv = {.idx = rigidbody_idx, .v = vel};
+    record_event(w, PHYSICS_RECORD_EVENT_SET_VELOCITY, &rv, sizeof(rv));
+    wake_rigidbody(w, rigidbody_idx);
+    w->velocities[rigidbody_slot(w, rigidbody_idx)] = vel;
+}
+
+void physics_add_force(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& f)
+{
+    RecordedVector rv = {.idx = rigidbody_idx, .v = f};
+    record_event(w, PHYSICS_RECORD_EVENT_ADD_FORCE, &rv, sizeof(rv));
+    wake_rigidbody(w, rigidbody_idx);
+    apply_force(w, rigidbody_idx, f);
+}
+
+void physics_add_torque(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& pivot, const Vec3& point, const Vec3& force)
+{
+    RecordedTorque rt = {.rigidbody_idx = rigidbody_idx, .pivot = pivot, .point = point, .force = force};
+    record_event(w, PHYSICS_RECORD_EVENT_ADD_TORQUE, &rt, sizeof(rt));
+    wake_rigidbody(w, rigidbody_idx);
+    let rb = w->rigidbodies + rigidbody_idx;
+    let slot = rigidbody_slot(w, rigidbody_idx);
+    w->angular_velocities[slot] += apply_inv_inertia(rb->inv_inertia, w->rotations[slot], cross(point - pivot, force));
+}
+
+PhysicsCollider physics_create_collider(u32 mesh_idx)
+{
+    return { .type = PHYSICS_COLLIDER_TYPE_MESH, .mesh_idx = mesh_idx };
+}
+
+PhysicsCollider physics_create_sphere_collider(f32 radius)
+{
+    return { .type = PHYSICS_COLLIDER_TYPE_SPHERE, .radius = radius };
+}
+
+PhysicsCollider physics_create_box_collider(const Vec3& half_extents)
+{
+    return { .type = PHYSICS_COLLIDER_TYPE_BOX, .half_extents = half_extents };
+}
+
+PhysicsCollider physics_create_box_collider_from_mesh(u32 mesh_idx)
+{
+    let m = ps.meshes + mesh_idx;
+    check(len(m->bounds_center) <= len(m->bounds_extents) * 0.001f, "Mesh %s isn't centered on its origin", m->filename);
+    return physics_create_box_collider(m->bounds_extents);
+}
+
+PhysicsCollider physics_create_capsule_collider(f32 radius, f32 half_height)
+{
+    return { .type = PHYSICS_COLLIDER_TYPE_CAPSULE, .radius = radius, .half_height = half_height };
+}
+
+PhysicsCollider physics_create_plane_collider()
+{
+    return { .type = PHYSICS_COLLIDER_TYPE_PLANE };
+}
+
+PhysicsCollider physics_create_triangle_mesh_collider(u32 mesh_idx)
+{
+    check(ps.meshes[mesh_idx].bvh, "Mesh %s has no triangles", ps.meshes[mesh_idx].filename);
+    return { .type = PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH, .mesh_idx = mesh_idx };
+}
+
+#define SOLVER_DEFAULT_ITERATIONS 8
+
+PhysicsWorld* physics_create_world()
+{
+    let w = mema_zero_t(PhysicsWorld);
+    da_push(w->objects, PhysicsObject{}); // zero-dummy
+    da_push(w->rigidbodies, Rigidbody{}); // zero-dummy
+    da_push(w->object_slots, 0u); // dummy object has no slot
+    w->interpolation_alpha = 1;
+    w->solver_iterations = SOLVER_DEFAULT_ITERATIONS;
+    return w;
+}
+
+void physics_set_solver_iterations(PhysicsWorld* w, u32 iterations)
+{
+    check(iterations > 0, "Contact solver needs at least one iteration");
+    RecordedValue rv = {.value = iterations};
+    record_event(w, PHYSICS_RECORD_EVENT_SET_SOLVER_ITERATIONS, &rv, sizeof(rv));
+    w->solver_iterations = iterations;
+}
+
+void physics_set_deterministic(PhysicsWorld* w, f32 steps_per_second)
+{
+    check(steps_per_second > 0, "Deterministic physics needs a positive step rate");
+    check(!w->recording, "Can't change step rate while recording");
+    w->fixed_dt = 1.0f / steps_per_second;
+    w->deterministic = true;
+    w->accumulator = 0;
+    w->interpolation_alpha = 1;
+}
+
+void physics_set_fixed_timestep(PhysicsWorld* w, f32 steps_per_second, u32 max_substeps)
+{
+    check(steps_per_second >= 0, "Physics step rate can't be negative");
+    check(steps_per_second == 0 || max_substeps > 0, "Fixed step physics needs at least one substep per update");
+    check(!w->recording, "Can't change step rate while recording");
+    w->deterministic = false;
+    w->fixed_dt = steps_per_second > 0 ? 1.0f / steps_per_second : 0;
+    w->max_substeps = max_substeps;
+    w->accumulator = 0;
+    w->interpolation_alpha = 1;
+}
+
+#define BROADPHASE_MARGIN 0.1f
+
+// Planes are unbounded, this is far enough to overlap everything.
+#define PLANE_AABB_EXTENT 1e18f
+
+static void collider_local_bounds(const PhysicsCollider& c, Vec3* center, Vec3* extents)
+{
+    *center = vec3_zero;
+
+    switch(c.type)
+    {
+        case PHYSICS_COLLIDER_TYPE_MESH:
+        case PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH: {
+            let m = ps.meshes + c.mesh_idx;
+            *center = m->bounds_center;
+            *extents = m->bounds_extents;
+        } break;
+
+        case PHYSICS_COLLIDER_TYPE_SPHERE: *extents = {c.radius, c.radius, c.radius}; break;
+        case PHYSICS_COLLIDER_TYPE_BOX: *extents = c.half_extents; break;
+        case PHYSICS_COLLIDER_TYPE_CAPSULE: *extents = {c.radius, c.radius, c.half_height + c.radius}; break;
+        default: error("Invalid collider type");
+    }
+}
+
+// Half size of the AABB around a box of extents e rotated by rot.
+static Vec3 rotated_extents(const Quat& rot, const Vec3& e)
+{
+    let ex = rotate_vec3(rot, {e.x, 0, 0});
+    let ey = rotate_vec3(rot, {0, e.y, 0});
+    let ez = rotate_vec3(rot, {0, 0, e.z});
+
+    return {
+        fabsf(ex.x) + fabsf(ey.x) + fabsf(ez.x),
+        fabsf(ex.y) + fabsf(ey.y) + fabsf(ez.y),
+        fabsf(ex.z) + fabsf(ey.z) + fabsf(ez.z)
+    };
+}
+
+// AABB in the local space of an object at pos and rot that contains b.
+static Aabb world_aabb_to_local(const Aabb& b, const Vec3& pos, const Quat& rot)
+{
+    let inv_rot = inverse(rot);
+    let c = rotate_vec3(inv_rot, (b.min + b.max) * 0.5f - pos);
+    let e = rotated_extents(inv_rot, (b.max - b.min) * 0.5f);
+    return {.min = c - e, .max = c + e};
+}
+
+static Aabb calc_world_aabb(const PhysicsObject& o, const Vec3& pos, const Quat& rot)
+{
+    if (o.collider.type == PHYSICS_COLLIDER_TYPE_PLANE)
+    {
+        Vec3 e = {PLANE_AABB_EXTENT, PLANE_AABB_EXTENT, PLANE_AABB_EXTENT};
+        return {.min = -e, .max = e};
+    }
+
+    Vec3 center, e;
+    collider_local_bounds(o.collider, &center, &e);
+    let world_extents = rotated_extents(rot, e);
+    let c = rotate_vec3(rot, center) + pos;
+
+    return {
+        .min = c - world_extents,
+        .max = c + world_extents
+    };
+}
+
+static bool aabb_overlaps(const Aabb& a, const Aabb& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x
+        && a.min.y <= b.max.y && a.max.y >= b.min.y
+        && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// AABB at the object's current position, with the broadphase margin.
+static void update_object_aabb(PhysicsWorld* w, PhysicsObject* o)
+{
+    let slot = w->object_slots[o->idx];
+    o->aabb = calc_world_aabb(*o, w->positions[slot], w->rotations[slot]);
+    Vec3 margin = {BROADPHASE_MARGIN, BROADPHASE_MARGIN, BROADPHASE_MARGIN};
+    o->aabb.min -= margin;
+    o->aabb.max += margin;
+}
+
+// Insertion sort on aabb.min.x, order barely changes between calls.
+static void sort_broadphase(PhysicsWorld* w)
+{
+    let sorted = w->broadphase_sorted;
+    let sorted_num = da_num(sorted);
+
+    for (u32 i = 1; i < sorted_num; ++i)
+    {
+        let cur = sorted[i];
+        let cur_min_x = w->objects[cur].aabb.min.x;
+        u32 j = i;
+
+        while (j > 0 && w->objects[sorted[j - 1]].aabb.min.x > cur_min_x)
+        {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+
+        sorted[j] = cur;
+    }
+}
+
+// Puts the object's AABB and broadphase order in the state the next update
+// would, so queries see objects that were created or moved since the last one.
+static void refresh_object_aabb(PhysicsWorld* w, u32 object_idx)
+{
+    let o = w->objects + object_idx;
+    update_object_aabb(w, o);
+
+    let sorted = w->broadphase_sorted;
+    let sorted_num = da_num(sorted);
+    u32 i = 0;
+
+    while (sorted[i] != object_idx)
+        ++i;
+
+    while (i > 0 && w->objects[sorted[i - 1]].aabb.min.x > o->aabb.min.x)
+    {
+        sorted[i] = sorted[i - 1];
+        sorted[--i] = object_idx;
+    }
+
+    while (i + 1 < sorted_num && w->objects[sorted[i + 1]].aabb.min.x < o->aabb.min.x)
+    {
+        sorted[i] = sorted[i + 1];
+        sorted[++i] = object_idx;
+    }
+}
+
+static bool collider_uses_mesh(const PhysicsCollider& c)
+{
+    return c.type == PHYSICS_COLLIDER_TYPE_MESH || c.type == PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH;
+}
+
+u32 physics_create_object(PhysicsWorld* w, const PhysicsCollider& collider, u32 render_object_idx, const Vec3& pos, const Quat& rot, const PhysicsMaterial& pm)
+{
+    let idx = da_num(w->objects_free_idx) > 0 ? da_pop(w->objects_free_idx) : da_num(w->objects);
+
+    PhysicsObject o = {
+        .idx = idx,
+        .collider = collider,
+        .render_object_idx = render_object_idx,
+        .material = pm
+    };
+
+    if (w->recording && collider_uses_mesh(collider) && (collider.mesh_idx >= da_num(w->recorded_meshes) || !w->recorded_meshes[collider.mesh_idx]))
+    {
+        let filename = ps.meshes[collider.mesh_idx].filename;
+        let filename_len = (u32)strlen(filename);
+        u32 event_header[] = {PHYSICS_RECORD_EVENT_LOAD_MESH, (u32)sizeof(u32) + filename_len};
+        record_bytes(w, event_header, sizeof(event_header));
+        record_bytes(w, &collider.mesh_idx, sizeof(u32));
+        record_bytes(w, filename, filename_len);
+
+        while (da_num(w->recorded_meshes) <= collider.mesh_idx)
+            da_push(w->recorded_meshes, false);
+
+        w->recorded_meshes[collider.mesh_idx] = true;
+    }
+
+    RecordedObject ro = {
+        .object_idx = idx,
+        .collider = collider,
+        .render_object_idx = render_object_idx,
+        .pos = pos,
+        .rot = rot,
+        .material = pm
+    };
+
+    record_event(w, PHYSICS_RECORD_EVENT_CREATE_OBJECT, &ro, sizeof(ro));
+    da_insert(w->objects, o, idx);
+    da_insert(w->object_slots, da_num(w->slot_objects), idx);
+    da_push(w->slot_objects, idx);
+    da_push(w->positions, pos);
+    da_push(w->rotations, rot);
+    da_push(w->prev_positions, pos);
+    da_push(w->prev_rotations, rot);
+    da_push(w->velocities, vec3_zero);
+    da_push(w->angular_velocities, vec3_zero);
+    da_push(w->sleeping, false);
+    da_push(w->broadphase_sorted, idx);
+    refresh_object_aabb(w, idx);
+    return idx;
+}
+
+
+void physics_set_position(PhysicsWorld* w, u32 object_idx, const Vec3& pos, const Quat& rot)
+{
+    RecordedPosition rp = {.object_idx = object_idx, .pos = pos, .rot = rot};
+    record_event(w, PHYSICS_RECORD_EVENT_SET_POSITION, &rp, sizeof(rp));
+    let o = w->objects + object_idx;
+    let slot = w->object_slots[object_idx];
+    w->positions[slot] = pos;
+    w->rotations[slot] = rot;
+
+    // Teleport, don't interpolate from the old place.
+    w->prev_positions[slot] = pos;
+    w->prev_rotations[slot] = rot;
+    refresh_object_aabb(w, object_idx);
+
+    if (o->rigidbody_idx)
+    {
+        wake_rigidbody(w, o->rigidbody_idx);
+        return;
+    }
+
+    // Objects without rigidbody can still be moved into sleeping ones.
+    da_foreach(other, w->objects)
+    {
+        if (other->rigidbody_idx && w->sleeping[w->object_slots[other->idx]] && aabb_overlaps(o->aabb, other->aabb))
+            wake_rigidbody(w, other->rigidbody_idx);
+    }
+}
+
+bool physics_is_sleeping(PhysicsWorld* w, u32 rigidbody_idx)
+{
+    return w->sleeping[rigidbody_slot(w, rigidbody_idx)];
+}
+
+static int pair_compare(const void* a, const void* b)
+{
+    let pa = (const PhysicsPair*)a;
+    let pb = (const PhysicsPair*)b;
+
+    if (pa->rigidbody_idx != pb->rigidbody_idx)
+        return pa->rigidbody_idx < pb->rigidbody_idx ? -1 : 1;
+
+    if (pa->object_idx != pb->object_idx)
+        return pa->object_idx < pb->object_idx ? -1 : 1;
+
+    return 0;
+}
+
+// Rigidbody that will be simulated this update, sleeping ones act as static.
+static bool is_awake_rigidbody(PhysicsWorld* w, const PhysicsObject& o)
+{
+    return o.rigidbody_idx && !w->sleeping[w->object_slots[o.idx]];
+}
+
+// Sweep and prune along x. Rigidbody AABBs are swept by the velocity they
+// will move with this frame, so pairs stay valid through integration.
+static void broadphase_find_pairs(PhysicsWorld* w, f32 dt)
+{
+    da_foreach(o, w->objects)
+    {
+        if (!o->idx)
+            continue;
+
+        update_object_aabb(w, o);
+
+        if (!is_awake_rigidbody(w, *o))
+            continue;
+
+        let d = w->velocities[w->object_slots[o->idx]] * dt;
+        o->aabb.min += {fminf(d.x, 0), fminf(d.y, 0), fminf(d.z, 0)};
+        o->aabb.max += {fmaxf(d.x, 0), fmaxf(d.y, 0), fmaxf(d.z, 0)};
+    }
+
+    sort_broadphase(w);
+    let sorted = w->broadphase_sorted;
+    let sorted_num = da_num(sorted);
+
+    let prev = w->pairs_prev;
+    w->pairs_prev = w->pairs;
+    w->pairs = prev;
+    da_clear(w->pairs);
+
+    for (u32 i = 0; i < sorted_num; ++i)
+    {
+        let a = w->objects + sorted[i];
+
+        for (u32 j = i + 1; j < sorted_num; ++j)
+        {
+            let b = w->objects + sorted[j];
+
+            if (b->aabb.min.x > a->aabb.max.x)
+                break;
+
+            let a_awake = is_awake_rigidbody(w, *a);
+            let b_awake = is_awake_rigidbody(w, *b);
+
+            if ((!a_awake && !b_awake) || !aabb_overlaps(a->aabb, b->aabb))
+                continue;
+
+            // Both halves are kept for CCD, which sweeps each rigidbody on its own.
+            if (a_awake)
+                da_push(w->pairs, (PhysicsPair{.rigidbody_idx = a->rigidbody_idx, .object_idx = b->idx, .mirrored = b_awake && b->rigidbody_idx < a->rigidbody_idx}));
+
+            if (b_awake)
+                da_push(w->pairs, (PhysicsPair{.rigidbody_idx = b->rigidbody_idx, .object_idx = a->idx, .mirrored = a_awake && a->rigidbody_idx < b->rigidbody_idx}));
+        }
+    }
+
+    // Resolve in rigidbody order, then object order, same as a brute force pass would.
+    if (da_num(w->pairs) > 1)
+        qsort(w->pairs, da_num(w->pairs), sizeof(PhysicsPair), pair_compare);
+
+    // Both arrays are sorted, carry over caches of pairs that persist.
+    u32 prev_idx = 0;
+    let prev_num = da_num(w->pairs_prev);
+
+    da_foreach(p, w->pairs)
+    {
+        while (prev_idx < prev_num && pair_compare(w->pairs_prev + prev_idx, p) < 0)
+            ++prev_idx;
+
+        if (prev_idx < prev_num && pair_compare(w->pairs_prev + prev_idx, p) == 0)
+        {
+            p->cache = w->pairs_prev[prev_idx].cache;
+            p->manifold = w->pairs_prev[prev_idx].manifold;
+        }
+    }
+}
+
+static u32 collider_hulls_num(const PhysicsCollider& c)
+{
+    return c.type == PHYSICS_COLLIDER_TYPE_MESH ? ps.meshes[c.mesh_idx].hulls_num : 1;
+}
+
+// hull_idx picks the piece of decomposed meshes, other colliders only have hull 0.
+static GjkShape get_gjk_shape(const PhysicsObject* o, const Vec3& pos, const Quat& rot, u32 hull_idx)
+{
+    let c = o->collider;
+
+    switch(c.type)
+    {
+        case PHYSICS_COLLIDER_TYPE_SPHERE: return {.pos = pos, .rot = rot, .type = GJK_SHAPE_TYPE_SPHERE, .radius = c.radius};
+        case PHYSICS_COLLIDER_TYPE_BOX: return {.pos = pos, .rot = rot, .type = GJK_SHAPE_TYPE_BOX, .half_extents = c.half_extents};
+        case PHYSICS_COLLIDER_TYPE_CAPSULE: return {.pos = pos, .rot = rot, .type = GJK_SHAPE_TYPE_CAPSULE, .radius = c.radius, .half_height = c.half_height};
+        case PHYSICS_COLLIDER_TYPE_PLANE: return {.pos = pos, .rot = rot};
+        default: break;
+    }
+
+    let h = ps.meshes[c.mesh_idx].hulls + hull_idx;
+
+    return {
+        .vertices = h->vertices,
+        .vertices_num = h->vertices_num,
+        .pos = pos,
+        .rot = rot,
+        .adjacency_offsets = h->adjacency_offsets,
+        .adjacency = h->adjacency,
+        .vertices_x = h->vertices_soa,
+        .vertices_y = h->vertices_soa ? h->vertices_soa + h->vertices_soa_num : NULL,
+        .vertices_z = h->vertices_soa ? h->vertices_soa + h->vertices_soa_num * 2 : NULL,
+        .vertices_soa_num = h->vertices_soa_num
+    };
+}
+
+static GjkShape object_gjk_shape(const PhysicsWorld* w, const PhysicsObject* o, u32 hull_idx)
+{
+    let slot = w->object_slots[o->idx];
+    return get_gjk_shape(o, w->positions[slot], w->rotations[slot], hull_idx);
+}
+
+#define SOLUTION_THRES 0.0001f
+
+static u32 island_find(u32* parents, u32 i)
+{
+    while (parents[i] != i)
+    {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+
+    return i;
+}
+
+static void island_union(u32* parents, u32 a, u32 b)
+{
+    let ra = island_find(parents, a);
+    let rb = island_find(parents, b);
+
+    // Lowest index becomes root so island ids don't depend on pair order.
+    if (ra < rb)
+        parents[rb] = ra;
+    else if (rb < ra)
+        parents[ra] = rb;
+}
+
+#define SLEEP_VELOCITY 0.05f
+#define SLEEP_ANGULAR_VELOCITY 0.05f
+#define SLEEP_FRAMES 30
+
+// Rigidbodies in contact with each other form islands. An island falls
+// asleep once all its rigidbodies have been still for SLEEP_FRAMES.
+static void update_sleep(PhysicsWorld* w, const Vec3& g, f32 dt)
+{
+    // Resting on something still gains up to g*dt before the contact removes it again.
+    let velocity_thres = SLEEP_VELOCITY + len(g) * dt;
+    let rigidbodies_num = da_num(w->rigidbodies);
+    da_clear(w->island_parents);
+    da_ensure_min_cap(w->island_parents, rigidbodies_num);
+
+    for (u32 i = 0; i < rigidbodies_num; ++i)
+        da_push(w->island_parents, i);
+
+    da_foreach(p, w->pairs)
+    {
+        let other_rb_idx = w->objects[p->object_idx].rigidbody_idx;
+
+        if (other_rb_idx && (p->result.colliding || p->manifold.points_num > 0))
+            island_union(w->island_parents, p->rigidbody_idx, other_rb_idx);
+    }
+
+    // A sleeping ring stays one island, so anything that settles against
+    // part of it is put in the same ring as all of it.
+    da_foreach(rb, w->rigidbodies)
+    {
+        if (rb->idx && w->sleeping[w->object_slots[rb->object_idx]])
+            island_union(w->island_parents, rb->idx, rb->sleep_island_next);
+    }
+
+    da_foreach(rb, w->rigidbodies)
+    {
+        let slot = w->object_slots[rb->object_idx];
+
+        if (!rb->idx || w->sleeping[slot])
+            continue;
+
+        if (len(w->velocities[slot]) < velocity_thres && len(w->angular_velocities[slot]) < SLEEP_ANGULAR_VELOCITY)
+            ++rb->still_frames;
+        else
+            rb->still_frames = 0;
+    }
+
+    // An island is as still as its most restless rigidbody.
+    let island_still = w->island_still_frames;
+    da_clear(island_still);
+    da_ensure_min_cap(island_still, rigidbodies_num);
+
+    // Islands without awake rigidbodies keep (u32)-1 and are left as they are.
+    for (u32 i = 0; i < rigidbodies_num; ++i)
+        da_push(island_still, (u32)-1);
+
+    w->island_still_frames = island_still;
+    da_clear(w->island_sleep_rings);
+    da_ensure_min_cap(w->island_sleep_rings, rigidbodies_num);
+
+    for (u32 i = 0; i < rigidbodies_num; ++i)
+        da_push(w->island_sleep_rings, 0u);
+
+    da_foreach(rb, w->rigidbodies)
+    {
+        if (!rb->idx || w->sleeping[w->object_slots[rb->object_idx]])
+            continue;
+
+        let root = island_find(w->island_parents, rb->idx);
+
+        if (rb->still_frames < island_still[root])
+            island_still[root] = rb->still_frames;
+    }
+
+    da_foreach(rb, w->rigidbodies)
+    {
+        if (!rb->idx)
+            continue;
+
+        let root = island_find(w->island_parents, rb->idx);
+
+        if (island_still[root] < SLEEP_FRAMES || island_still[root] == (u32)-1)
+            continue;
+
+        // Members that were already asleep are relinked too, their old rings
+        // are part of this island and end up in its one ring.
+        let ring = w->island_sleep_rings[root];
+
+        if (ring)
+        {
+            rb->sleep_island_next = w->rigidbodies[ring].sleep_island_next;
+            w->rigidbodies[ring].sleep_island_next = rb->idx;
+        }
+        else
+        {
+            rb->sleep_island_next = rb->idx;
+            w->island_sleep_rings[root] = rb->idx;
+        }
+
+        let slot = w->object_slots[rb->object_idx];
+
+        if (w->sleeping[slot])
+            continue;
+
+        w->sleeping[slot] = true;
+
+        // Integration still runs over sleeping slots, zero velocity keeps them in place.
+        w->velocities[slot] = vec3_zero;
+        w->angular_velocities[slot] = vec3_zero;
+
+        // Render syncing stops while asleep, so it must end up exactly here.
+        w->prev_positions[slot] = w->positions[slot];
+        w->prev_rotations[slot] = w->rotations[slot];
+    }
+
+    u32 sleeping_num = 0;
+
+    for (u32 i = 0; i < w->rigidbody_slots_num; ++i)
+        sleeping_num += w->sleeping[i];
+
+    w->stats.rigidbodies_sleeping = sleeping_num;
+}
+
+// Moving less than this part of the smallest collider extent in one step skips CCD.
+#define CCD_MOTION_THRESHOLD 0.5f
+// How close a sweep gets before it counts as a hit.
+#define CCD_TOLERANCE 0.01f
+#define CCD_MAX_ITERATIONS 16
+
+// Distance from s1 to s2, negative or zero if they overlap. normal points from s2 towards s1.
+static f32 shape_distance(const GjkShape& s1, const GjkShape& s2, PhysicsColliderType s2_type, Vec3* normal)
+{
+    if (s2_type == PHYSICS_COLLIDER_TYPE_PLANE)
+    {
+        let n = rotate_vec3(s2.rot, vec3_up);
+        *normal = n;
+        return dot(n, gjk_support(s1, -n) - s2.pos);
+    }
+
+    return gjk_distance(s1, s2, normal);
+}
+
+// Conservative advancement along motion. Distance between translating convex
+// shapes is convex over time, so stepping by distance over closing speed never
+// passes the first contact. Returns the part of motion that is free, 1 if
+// moved doesn't hit s2. Already overlapping pairs are left to the discrete test.
+static f32 shape_time_of_impact(GjkShape moved, const GjkShape& s2, PhysicsColliderType s2_type, const Vec3& motion, Vec3* hit_normal)
+{
+    let start = moved.pos;
+    f32 t = 0;
+
+    for (u32 i = 0; i < CCD_MAX_ITERATIONS; ++i)
+    {
+        Vec3 n;
+        let d = shape_distance(moved, s2, s2_type, &n);
+
+        // Rounding in the distance can step slightly past the contact, the
+        // normal from the previous step is still good then.
+        if (d <= 0)
+            return i == 0 ? 1 : t;
+
+        *hit_normal = n;
+        let closing_speed = -dot(motion, n);
+
+        if (closing_speed <= 0)
+            return 1;
+
+        if (d < CCD_TOLERANCE)
+            return t;
+
+        t += d / closing_speed;
+
+        if (t >= 1)
+            return 1;
+
+        moved.pos = start + motion * t;
+    }
+
+    return t;
+}
+
+// Returns false to stop visiting.
+typedef bool(*TriangleVisitFunc)(void* data, const Vec3* triangle);
+
+#define BVH_MAX_STACK 64
+
+// Visits the triangles of m whose bounds overlap local_aabb.
+static void visit_triangles(const PhysicsMesh* m, const Aabb& local_aabb, TriangleVisitFunc visit, void* data)
+{
+    u32 stack[BVH_MAX_STACK];
+    u32 stack_num = 0;
+    stack[stack_num++] = 0;
+
+    while (stack_num > 0)
+    {
+        let n = m->bvh + stack[--stack_num];
+
+        if (!aabb_overlaps(n->bounds, local_aabb))
+            continue;
+
+        if (n->num == 0)
+        {
+            check(stack_num + 2 <= BVH_MAX_STACK, "BVH of %s is too deep", m->filename);
+            stack[stack_num++] = n->first + 1;
+            stack[stack_num++] = n->first;
+            continue;
+        }
+
+        for (u32 i = n->first; i < n->first + n->num; ++i)
+        {
+            let t = m->triangles + i * 3;
+
+            if (aabb_overlaps(triangle_bounds(t), local_aabb) && !visit(data, t))
+                return;
+        }
+    }
+}
+
+// Triangles are placed like the triangle mesh object they belong to.
+struct TriangleMeshQuery
+{
+    const GjkShape* shape;
+    Vec3 pos;
+    Quat rot;
+    Vec3 motion; // sweeps
+    f32 first; // sweeps, part of motion before the first hit
+    Vec3 normal; // sweeps
+    GjkEpaSolution deepest; // collisions
+    GjkEpaStats* stats; // collisions
+    bool overlaps; // overlap tests
+};
+
+static GjkShape triangle_shape(const TriangleMeshQuery* q, const Vec3* triangle)
+{
+    return {.vertices = triangle, .vertices_num = 3, .pos = q->pos, .rot = q->rot};
+}
+
+static bool sweep_triangle(void* data, const Vec3* triangle)
+{
+    let q = (TriangleMeshQuery*)data;
+    Vec3 n = vec3_zero;
+    let t = shape_time_of_impact(*q->shape, triangle_shape(q, triangle), PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH, q->motion, &n);
+
+    if (t < q->first)
+    {
+        q->first = t;
+        q->normal = n;
+    }
+
+    return true;
+}
+
+// First hit of any hull of o1 with any hull of o2, see shape_time_of_impact.
+static f32 time_of_impact(const PhysicsWorld* w, const PhysicsObject* o1, const PhysicsObject* o2, const Vec3& motion, Vec3* hit_normal)
+{
+    let slot1 = w->object_slots[o1->idx];
+    f32 first = 1;
+
+    for (u32 h1 = 0; h1 < collider_hulls_num(o1->collider); ++h1)
+    {
+        let moved = get_gjk_shape(o1, w->positions[slot1], w->rotations[slot1], h1);
+
+        if (o2->collider.type == PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH)
+        {
+            let slot2 = w->object_slots[o2->idx];
+            TriangleMeshQuery q = {.shape = &moved, .pos = w->positions[slot2], .rot = w->rotations[slot2], .motion = motion, .first = first};
+            visit_triangles(ps.meshes + o2->collider.mesh_idx, world_aabb_to_local(o1->aabb, q.pos, q.rot), sweep_triangle, &q);
+
+            if (q.first < first)
+            {
+                first = q.first;
+                *hit_normal = q.normal;
+            }
+
+            continue;
+        }
+
+        for (u32 h2 = 0; h2 < collider_hulls_num(o2->collider); ++h2)
+        {
+            Vec3 n = vec3_zero;
+            let t = shape_time_of_impact(moved, object_gjk_shape(w, o2, h2), o2->collider.type, motion, &n);
+
+            if (t < first)
+            {
+                first = t;
+                *hit_normal = n;
+            }
+        }
+    }
+
+    return first;
+}
+
+static f32 min_extent(const PhysicsObject& o)
+{
+    Vec3 center, e;
+    collider_local_bounds(o.collider, &center, &e);
+    return fminf(e.x, fminf(e.y, e.z));
+}
+
+static GjkEpaSolution collide_box_sphere(const GjkShape& s1, const GjkShape& s2)
+{
+    return collide_flipped(collide_sphere_box(s2, s1));
+}
+
+static GjkEpaSolution collide_capsule_sphere(const GjkShape& s1, const GjkShape& s2)
+{
+    return collide_flipped(collide_sphere_capsule(s2, s1));
+}
+
+static GjkEpaSolution collide_with_plane(const GjkShape& s1, const GjkShape& s2)
+{
+    return collide_convex_plane(s1, s2.pos, s2.rot);
+}
+
+static GjkEpaSolution collide_plane_with(const GjkShape& s1, const GjkShape& s2)
+{
+    return collide_flipped(collide_convex_plane(s2, s1.pos, s1.rot));
+}
+
+static GjkEpaSolution collide_never(const GjkShape&, const GjkShape&)
+{
+    return {.colliding = false};
+}
+
+typedef GjkEpaSolution(*CollidePairFunc)(const GjkShape& s1, const GjkShape& s2);
+
+// Indexed by PhysicsColliderType of the rigidbody and then of the other
+// object. NULL means GJK/EPA. Triangle meshes are tested per triangle
+// before looking here.
+static CollidePairFunc collide_pair_funcs[PHYSICS_COLLIDER_TYPE_NUM][PHYSICS_COLLIDER_TYPE_NUM] = {
+    /* mesh */ {NULL, NULL, NULL, NULL, collide_with_plane, NULL},
+    /* sphere */ {NULL, collide_sphere_sphere, collide_sphere_box, collide_sphere_capsule, collide_with_plane, NULL},
+    /* box */ {NULL, collide_box_sphere, collide_box_box, NULL, collide_with_plane, NULL},
+    /* capsule */ {NULL, collide_capsule_sphere, NULL, collide_capsule_capsule, collide_with_plane, NULL},
+    /* plane */ {collide_plane_with, collide_plane_with, collide_plane_with, collide_plane_with, collide_never, collide_never},
+    /* triangle mesh */ {collide_never, collide_never, collide_never, collide_never, collide_never, collide_never}
+};
+
+// Cosine of how far EPA's normal can be from a triangle's own normal and
+// still be replaced by it.
+#define TRIANGLE_NORMAL_SNAP 0.9f
+
+static bool collide_triangle(void* data, const Vec3* triangle)
+{
+    let q = (TriangleMeshQuery*)data;
+    GjkEpaSolution r = gjk_epa_intersect_and_solve(*q->shape, triangle_shape(q, triangle), NULL, q->stats);
+
+    // EPA against something flat leaves the normal slightly off, which makes
+    // resting bodies creep. Near face contacts are redone like a plane contact.
+    if (r.colliding && len(r.solution) > SOLUTION_THRES)
+    {
+        let n = normalize(rotate_vec3(q->rot, cross(triangle[1] - triangle[0], triangle[2] - triangle[0])));
+        let facing = dot(n, r.solution) < 0 ? -n : n;
+
+        if (dot(normalize(r.solution), facing) > TRIANGLE_NORMAL_SNAP)
+        {
+            let deepest = gjk_support(*q->shape, -facing);
+            let depth = dot(facing, rotate_vec3(q->rot, triangle[0]) + q->pos - deepest);
+
+            if (depth > 0)
+                r = {.colliding = true, .solution = facing * depth, .contact_point = deepest};
+        }
+    }
+
+    if (r.colliding && (!q->deepest.colliding || len(r.solution) > len(q->deepest.solution)))
+        q->deepest = r;
+
+    return true;
+}
+
+// Deepest contact of o1 with the triangles of o2 near it, like decomposed
+// meshes the manifold collects the others over the next steps.
+static GjkEpaSolution collide_triangle_mesh(const PhysicsWorld* w, const PhysicsObject* o1, const PhysicsObject* o2, GjkEpaStats* stats)
+{
+    let slot2 = w->object_slots[o2->idx];
+    TriangleMeshQuery q = {.pos = w->positions[slot2], .rot = w->rotations[slot2], .deepest = {.colliding = false}, .stats = stats};
+    let local_aabb = world_aabb_to_local(o1->aabb, q.pos, q.rot);
+
+    for (u32 h = 0; h < collider_hulls_num(o1->collider); ++h)
+    {
+        let shape = object_gjk_shape(w, o1, h);
+        q.shape = &shape;
+        visit_triangles(ps.meshes + o2->collider.mesh_idx, local_aabb, collide_triangle, &q);
+    }
+
+    return q.deepest;
+}
+
+#define NARROWPHASE_BATCH_SIZE 16
+
+struct NarrowphaseJob
+{
+    PhysicsWorld* w;
+};
+
+static void narrowphase_job(void* data, u32 start, u32 end)
+{
+    let w = ((NarrowphaseJob*)data)->w;
+    let stats = w->narrowphase_stats + start / NARROWPHASE_BATCH_SIZE;
+
+    for (u32 i = start; i < end; ++i)
+    {
+        let pair = w->pairs + i;
+
+        if (pair->mirrored)
+        {
+            pair->result = {.colliding = false};
+            continue;
+        }
+
+        let o1 = w->objects + w->rigidbodies[pair->rigidbody_idx].object_idx;
+        let o2 = w->objects + pair->object_idx;
+
+        if (o2->collider.type == PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH)
+        {
+            pair->result = collide_triangle_mesh(w, o1, o2, stats);
+            continue;
+        }
+
+        let collide = collide_pair_funcs[o1->collider.type][o2->collider.type];
+        let hulls1_num = collider_hulls_num(o1->collider);
+        let hulls2_num = collider_hulls_num(o2->collider);
+
+        if (hulls1_num == 1 && hulls2_num == 1)
+        {
+            let s1 = object_gjk_shape(w, o1, 0);
+            let s2 = object_gjk_shape(w, o2, 0);
+            pair->result = collide ? collide(s1, s2) : gjk_epa_intersect_and_solve(s1, s2, &pair->cache, stats);
+            continue;
+        }
+
+        // Decomposed meshes report their deepest hull pair, the manifold
+        // collects the others over the next steps. The cache only fits one
+        // pair of shapes, so it isn't used.
+        pair->result = {.colliding = false};
+        f32 deepest = -1;
+
+        for (u32 h1 = 0; h1 < hulls1_num; ++h1)
+        {
+            let s1 = object_gjk_shape(w, o1, h1);
+
+            for (u32 h2 = 0; h2 < hulls2_num; ++h2)
+            {
+                let s2 = object_gjk_shape(w, o2, h2);
+                let r = collide ? collide(s1, s2) : gjk_epa_intersect_and_solve(s1, s2, NULL, stats);
+
+                if (r.colliding && len(r.solution) > deepest)
+                {
+                    deepest = len(r.solution);
+                    pair->result = r;
+                }
+            }
+        }
+    }
+}
+
+// Separating or sliding further than this drops a manifold point.
+#define CONTACT_BREAK_DISTANCE 0.05f
+// Cosine of how far the normal can turn before the manifold starts over.
+#define CONTACT_NORMAL_TOLERANCE 0.95f
+// Penetration that is left alone, so resting contacts keep touching between steps.
+#define CONTACT_SLOP 0.01f
+// Part of the remaining penetration pushed out each step.
+#define CONTACT_BAUMGARTE 0.2f
+// Deep penetration is pushed out over several steps instead of launching things.
+#define CONTACT_MAX_CORRECTION_VELOCITY 2.0f
+// Slower approaches than this don't bounce.
+#define CONTACT_RESTITUTION_VELOCITY 1.0f
+
+static f32 quad_area(const Vec3& p0, const Vec3& p1, const Vec3& p2, const Vec3& p3)
+{
+    let a = len(cross(p0 - p1, p2 - p3));
+    let b = len(cross(p0 - p2, p1 - p3));
+    let c = len(cross(p0 - p3, p1 - p2));
+    return fmaxf(a, fmaxf(b, c));
+}
+
+// Drops points that came apart and adds the one narrowphase found this step.
+static void update_manifold(PhysicsWorld* w, PhysicsPair* pair)
+{
+    let m = &pair->manifold;
+    let slot_a = w->object_slots[w->rigidbodies[pair->rigidbody_idx].object_idx];
+    let slot_b = w->object_slots[pair->object_idx];
+    let pos_a = w->positions[slot_a];
+    let rot_a = w->rotations[slot_a];
+    let pos_b = w->positions[slot_b];
+    let rot_b = w->rotations[slot_b];
+    let coll = pair->result;
+    let found = coll.colliding && len(coll.solution) > SOLUTION_THRES;
+
+    if (found)
+    {
+        let n = normalize(coll.solution);
+
+        if (m->points_num > 0 && dot(n, m->normal) < CONTACT_NORMAL_TOLERANCE)
+            m->points_num = 0;
+
+        m->normal = n;
+    }
+
+    u32 kept = 0;
+
+    for (u32 i = 0; i < m->points_num; ++i)
+    {
+        let p = m->points[i];
+        let d = (rotate_vec3(rot_b, p.local_b) + pos_b) - (rotate_vec3(rot_a, p.local_a) + pos_a);
+        let depth = dot(d, m->normal);
+
+        if (depth < -CONTACT_BREAK_DISTANCE || len(d - m->normal * depth) > CONTACT_BREAK_DISTANCE)
+            continue;
+
+        m->points[kept++] = p;
+    }
+
+    m->points_num = kept;
+
+    if (!found)
+        return;
+
+    // contact_point is the deepest point of the rigidbody, the solution moves it onto the other surface.
+    ContactPoint np = {
+        .local_a = rotate_vec3(inverse(rot_a), coll.contact_point - pos_a),
+        .local_b = rotate_vec3(inverse(rot_b), coll.contact_point + coll.solution - pos_b)
+    };
+
+    // Same point as in an earlier step, keep its impulses for warm starting.
+    for (u32 i = 0; i < m->points_num; ++i)
+    {
+        if (len(m->points[i].local_a - np.local_a) < CONTACT_BREAK_DISTANCE)
+        {
+            m->points[i].local_a = np.local_a;
+            m->points[i].local_b = np.local_b;
+            return;
+        }
+    }
+
+    if (m->points_num < MANIFOLD_MAX_POINTS)
+    {
+        m->points[m->points_num++] = np;
+        return;
+    }
+
+    // Full, the new point replaces whichever one leaves the largest area.
+    u32 replace = 0;
+    f32 replace_area = -1;
+
+    for (u32 i = 0; i < MANIFOLD_MAX_POINTS; ++i)
+    {
+        Vec3 q[MANIFOLD_MAX_POINTS];
+
+        for (u32 j = 0; j < MANIFOLD_MAX_POINTS; ++j)
+            q[j] = j == i ? np.local_a : m->points[j].local_a;
+
+        let area = quad_area(q[0], q[1], q[2], q[3]);
+
+        if (area > replace_area)
+        {
+            replace_area = area;
+            replace = i;
+        }
+    }
+
+    m->points[replace] = np;
+}
+
+// Depends only on n, so friction impulses stay meaningful between steps.
+static void tangent_basis(const Vec3& n, Vec3* t1, Vec3* t2)
+{
+    *t1 = fabsf(n.x) > 0.57735f ? normalize(Vec3{n.y, -n.x, 0}) : normalize(Vec3{0, n.z, -n.y});
+    *t2 = cross(n, *t1);
+}
+
+// Velocity of a relative to b at the contact.
+static Vec3 contact_velocity(const Vec3* velocities, const Vec3* angular_velocities, const ContactConstraint& c)
+{
+    return velocities[c.slot_a] + cross(angular_velocities[c.slot_a], c.ra)
+        - velocities[c.slot_b] - cross(angular_velocities[c.slot_b], c.rb);
+}
+
+// Static and sleeping objects have zero inverse mass and inertia, so the
+// impulse leaves their zero velocity alone.
+static void apply_contact_impulse(Vec3* velocities, Vec3* angular_velocities, const ContactConstraint& c, u32 axis, f32 impulse)
+{
+    let p = c.axes[axis] * impulse;
+    velocities[c.slot_a] += p * c.inv_mass_a;
+    angular_velocities[c.slot_a] += c.angular_a[axis] * impulse;
+    velocities[c.slot_b] -= p * c.inv_mass_b;
+    angular_velocities[c.slot_b] -= c.angular_b[axis] * impulse;
+}
+
+static void add_contacts(PhysicsWorld* w, PhysicsPair* pair, f32 dt)
+{
+    let m = &pair->manifold;
+
+    if (m->points_num == 0)
+        return;
+
+    let rb_a = w->rigidbodies + pair->rigidbody_idx;
+    let o_a = w->objects + rb_a->object_idx;
+    let o_b = w->objects + pair->object_idx;
+    let slot_a = w->object_slots[o_a->idx];
+    let slot_b = w->object_slots[o_b->idx];
+    let pos_a = w->positions[slot_a];
+    let rot_a = w->rotations[slot_a];
+    let pos_b = w->positions[slot_b];
+    let rot_b = w->rotations[slot_b];
+    let rb_b = o_b->rigidbody_idx && !w->sleeping[slot_b] ? w->rigidbodies + o_b->rigidbody_idx : NULL;
+    let inv_inertia_b = rb_b ? rb_b->inv_inertia : vec3_zero;
+    let restitution = fmaxf(o_a->material.elasticity, o_b->material.elasticity);
+    Vec3 axes[3] = {m->normal};
+    tangent_basis(m->normal, axes + 1, axes + 2);
+
+    for (u32 i = 0; i < m->points_num; ++i)
+    {
+        let p = m->points + i;
+        let wa = rotate_vec3(rot_a, p->local_a) + pos_a;
+        let wb = rotate_vec3(rot_b, p->local_b) + pos_b;
+
+        ContactConstraint c = {
+            .point = p,
+            .slot_a = slot_a,
+            .slot_b = slot_b,
+            .inv_mass_a = rb_a->inv_mass,
+            .inv_mass_b = rb_b ? rb_b->inv_mass : 0,
+            .ra = wa - pos_a,
+            .rb = wb - pos_b,
+            .friction = fminf(o_a->material.friction + o_b->material.friction, 1)
+        };
+
+        for (u32 k = 0; k < 3; ++k)
+        {
+            let ra_x = cross(c.ra, axes[k]);
+            let rb_x = cross(c.rb, axes[k]);
+            c.axes[k] = axes[k];
+            c.angular_a[k] = apply_inv_inertia(rb_a->inv_inertia, rot_a, ra_x);
+            c.angular_b[k] = apply_inv_inertia(inv_inertia_b, rot_b, rb_x);
+            let k_inv = c.inv_mass_a + c.inv_mass_b + dot(ra_x, c.angular_a[k]) + dot(rb_x, c.angular_b[k]);
+            c.effective_mass[k] = k_inv > 0 ? 1 / k_inv : 0;
+        }
+
+        // Separated points still in the manifold may close the gap, but not more.
+        let depth = dot(wb - wa, m->normal);
+        let vn = dot(contact_velocity(w->velocities, w->angular_velocities, c), m->normal);
+        c.target_velocity = depth < 0 ? depth / dt : 0;
+        c.bias_target_velocity = fminf(CONTACT_BAUMGARTE * fmaxf(depth - CONTACT_SLOP, 0) / dt, CONTACT_MAX_CORRECTION_VELOCITY);
+
+        if (vn < -CONTACT_RESTITUTION_VELOCITY)
+            c.target_velocity = fmaxf(c.target_velocity, -restitution * vn);
+
+        da_push(w->contacts, c);
+    }
+}
+
+// Sequential impulses. Each contact is solved on its own against the latest
+// velocities, iterating makes them agree. Impulses are accumulated per
+// manifold point and clamped as totals, starting from the last step's.
+// Penetration is pushed out through separate bias velocities that only
+// move this step, so it doesn't add energy that keeps stacks jittering.
+static void solve_contacts(PhysicsWorld* w)
+{
+    let v = w->velocities;
+    let av = w->angular_velocities;
+    let slots_num = da_num(w->positions);
+    da_clear(w->bias_velocities);
+    da_clear(w->bias_angular_velocities);
+    da_ensure_min_cap(w->bias_velocities, slots_num);
+    da_ensure_min_cap(w->bias_angular_velocities, slots_num);
+
+    for (u32 i = 0; i < slots_num; ++i)
+    {
+        da_push(w->bias_velocities, vec3_zero);
+        da_push(w->bias_angular_velocities, vec3_zero);
+    }
+
+    let bv = w->bias_velocities;
+    let bav = w->bias_angular_velocities;
+
+    da_foreach(c, w->contacts)
+    {
+        apply_contact_impulse(v, av, *c, 0, c->point->normal_impulse);
+        apply_contact_impulse(v, av, *c, 1, c->point->tangent_impulses[0]);
+        apply_contact_impulse(v, av, *c, 2, c->point->tangent_impulses[1]);
+    }
+
+    for (u32 iteration = 0; iteration < w->solver_iterations; ++iteration)
+    {
+        da_foreach(c, w->contacts)
+        {
+            let p = c->point;
+
+            // Friction first, so non-penetration gets the last word.
+            for (u32 k = 1; k < 3; ++k)
+            {
+                let max_friction = c->friction * p->normal_impulse;
+                let vt = dot(contact_velocity(v, av, *c), c->axes[k]);
+                let old = p->tangent_impulses[k - 1];
+                p->tangent_impulses[k - 1] = clamp(old - vt * c->effective_mass[k], -max_friction, max_friction);
+                apply_contact_impulse(v, av, *c, k, p->tangent_impulses[k - 1] - old);
+            }
+
+            let vn = dot(contact_velocity(v, av, *c), c->axes[0]);
+            let old = p->normal_impulse;
+            p->normal_impulse = fmaxf(old + (c->target_velocity - vn) * c->effective_mass[0], 0);
+            apply_contact_impulse(v, av, *c, 0, p->normal_impulse - old);
+
+            let bias_vn = dot(contact_velocity(bv, bav, *c), c->axes[0]);
+            let old_bias = c->bias_impulse;
+            c->bias_impulse = fmaxf(old_bias + (c->bias_target_velocity - bias_vn) * c->effective_mass[0], 0);
+            apply_contact_impulse(bv, bav, *c, 0, c->bias_impulse - old_bias);
+        }
+    }
+}
+
+static void step_world(PhysicsWorld* w, f32 dt)
+{
+    u32 objects_num = 0;
+    u32 rigidbodies_num = 0;
+
+    da_foreach(o, w->objects)
+        if (o->idx)
+            ++objects_num;
+
+    da_foreach(rb, w->rigidbodies)
+        if (rb->idx)
+            ++rigidbodies_num;
+
+    w->stats.pairs_brute_force += objects_num > 0 ? rigidbodies_num * (objects_num - 1) : 0;
+    ++w->stats.substeps;
+
+    broadphase_find_pairs(w, dt);
+    let pairs_num = da_num(w->pairs);
+    Vec3 g = {0, 0, -9.82f};
+
+    for (u32 i = 0; i < w->rigidbody_slots_num; ++i)
+        if (!w->sleeping[i])
+            w->velocities[i] += g * dt;
+
+    // All pairs are tested against the state at the start of the step, so
+    // they can run in any order.
+    da_clear(w->narrowphase_stats);
+
+    for (u32 i = 0; i < pairs_num; i += NARROWPHASE_BATCH_SIZE)
+        da_push(w->narrowphase_stats, GjkEpaStats{});
+
+    NarrowphaseJob nj = {
+        .w = w
+    };
+
+    jobs_parallel_for(pairs_num, NARROWPHASE_BATCH_SIZE, narrowphase_job, &nj);
+
+    da_foreach(p, w->pairs)
+        if (!p->mirrored)
+            ++w->stats.pairs_tested;
+
+    da_foreach(s, w->narrowphase_stats)
+    {
+        w->stats.pairs_reused += s->cache_hits;
+        w->stats.gjk_iterations += s->gjk_iterations;
+        w->stats.epa_iterations += s->epa_iterations;
+    }
+
+    da_foreach(pair, w->pairs)
+    {
+        if (pair->mirrored)
+            continue;
+
+        let coll = pair->result;
+
+        if (coll.colliding)
+        {
+            ++w->stats.pairs_colliding;
+            let other_rb_idx = w->objects[pair->object_idx].rigidbody_idx;
+
+            // Something hit a sleeping island, wake it up.
+            if (other_rb_idx && w->sleeping[w->object_slots[pair->object_idx]] && len(coll.solution) > SOLUTION_THRES)
+                wake_rigidbody(w, other_rb_idx);
+        }
+
+        update_manifold(w, pair);
+    }
+
+    da_clear(w->contacts);
+
+    da_foreach(pair, w->pairs)
+        if (!pair->mirrored)
+            add_contacts(w, pair, dt);
+
+    w->stats.contacts += da_num(w->contacts);
+    solve_contacts(w);
+
+    da_foreach(c, w->contacts)
+    {
+        let p = w->positions[c->slot_a] + c->ra;
+        Vec3 verts[] = {p, p + c->axes[0] * (c->point->normal_impulse * c->inv_mass_a)};
+        Vec4 colors[] = {vec4_red, vec4_green};
+        debug_draw(verts, 2, colors, PRIMITIVE_TOPOLOGY_LINE_STRIP);
+    }
+
+    // Sweep the motion integration below will do, for fast rigidbodies.
+    u32 pair_idx = 0;
+
+    da_foreach(rb, w->rigidbodies)
+    {
+        let rb_idx = arr_idx(rb, w->rigidbodies);
+        let first_pair_idx = pair_idx;
+
+        while (pair_idx < pairs_num && w->pairs[pair_idx].rigidbody_idx == rb_idx)
+            ++pair_idx;
+
+        let slot = w->object_slots[rb->object_idx];
+
+        if (!rb->idx || !rb->ccd || w->sleeping[slot])
+            continue;
+
+        let wo = w->objects + rb->object_idx;
+        let pos = w->positions + slot;
+        let velocity = w->velocities + slot;
+        let motion = *velocity * dt;
+        f32 free_motion = 1;
+        Vec3 hit_normal = vec3_zero;
+
+        if (len(motion) > min_extent(*wo) * CCD_MOTION_THRESHOLD)
+        {
+            for (u32 i = first_pair_idx; i < pair_idx; ++i)
+            {
+                Vec3 n;
+                let toi = time_of_impact(w, wo, w->objects + w->pairs[i].object_idx, motion * free_motion, &n);
+
+                if (toi < 1)
+                {
+                    free_motion *= toi;
+                    hit_normal = n;
+                }
+            }
+        }
+
+        // Stop like a resting contact would, the discrete test takes over next
+        // step. Position is offset so integrating the new velocity ends up at
+        // the contact. Penetration recovery would push it on past the contact,
+        // so it's dropped for this step.
+        if (free_motion < 1)
+        {
+            ++w->stats.ccd_hits;
+            let vel_normal = dot(*velocity, hit_normal);
+
+            if (vel_normal < 0)
+                *velocity -= hit_normal * vel_normal;
+
+            *pos += motion * free_motion - *velocity * dt;
+            w->bias_velocities[slot] = vec3_zero;
+            w->bias_angular_velocities[slot] = vec3_zero;
+        }
+    }
+
+    // Move rigidbodies according to velocities. Sleeping ones have zero
+    // velocity, so this can run over all rigidbody slots without branching.
+    let rigidbody_slots_num = w->rigidbody_slots_num;
+
+    for (u32 i = 0; i < rigidbody_slots_num; ++i)
+        w->positions[i] += (w->velocities[i] + w->bias_velocities[i]) * dt;
+
+    // Angular velocity is in world space, so it rotates from the outside.
+    for (u32 i = 0; i < rigidbody_slots_num; ++i)
+        w->rotations[i] = quat_from_axis_angle(w->angular_velocities[i] + w->bias_angular_velocities[i], dt) * w->rotations[i];
+
+    update_sleep(w, g, dt);
+
+    // The AABBs broadphase made are from before the solver, CCD and
+    // integration moved things. Queries cull with them, so they are
+    // brought up to date with where rigidbodies ended up.
+    for (u32 i = 0; i < rigidbody_slots_num; ++i)
+        update_object_aabb(w, w->objects + w->slot_objects[i]);
+
+    sort_broadphase(w);
+}
+
+void physics_update_world(PhysicsWorld* w)
+{
+    if (w->deterministic)
+    {
+        record_event(w, PHYSICS_RECORD_EVENT_UPDATE, NULL, 0);
+        w->stats = {};
+        step_world(w, w->fixed_dt);
+        return;
+    }
+
+    if (w->fixed_dt == 0)
+    {
+        w->stats = {};
+        step_world(w, time_dt());
+        return;
+    }
+
+    w->accumulator += time_dt();
+    u32 steps = 0;
+
+    while (w->accumulator >= w->fixed_dt && steps < w->max_substeps)
+    {
+        // Updates that run no substep keep the counters of the last one that did.
+        if (steps == 0)
+            w->stats = {};
+
+        memcpy(w->prev_positions, w->positions, da_num(w->positions) * sizeof(Vec3));
+        memcpy(w->prev_rotations, w->rotations, da_num(w->rotations) * sizeof(Quat));
+
+        step_world(w, w->fixed_dt);
+        w->accumulator -= w->fixed_dt;
+        ++steps;
+    }
+
+    // Hit the substep cap, drop the backlog instead of spiralling on the next update.
+    if (w->accumulator >= w->fixed_dt)
+        w->accumulator = fmodf(w->accumulator, w->fixed_dt);
+
+    w->interpolation_alpha = w->accumulator / w->fixed_dt;
+}
+
+void physics_destroy_world(PhysicsWorld* w)
+{
+    da_free(w->objects);
+    da_free(w->objects_free_idx);
+    da_free(w->rigidbodies);
+    da_free(w->rigidbodies_free_idx);
+    da_free(w->object_slots);
+    da_free(w->slot_objects);
+    da_free(w->positions);
+    da_free(w->rotations);
+    da_free(w->prev_positions);
+    da_free(w->prev_rotations);
+    da_free(w->velocities);
+    da_free(w->angular_velocities);
+    da_free(w->bias_velocities);
+    da_free(w->bias_angular_velocities);
+    da_free(w->sleeping);
+    da_free(w->broadphase_sorted);
+    da_free(w->pairs);
+    da_free(w->pairs_prev);
+    da_free(w->contacts);
+    da_free(w->narrowphase_stats);
+    da_free(w->island_parents);
+    da_free(w->island_still_frames);
+    da_free(w->island_sleep_rings);
+    da_free(w->recording_data);
+    da_free(w->recorded_meshes);
+    memf(w);
+}
+
+void physics_shutdown()
+{
+    for (u32 i = 0; i < da_num(ps.meshes); ++i)
+        if (ps.meshes[i].idx)
+            physics_destroy_mesh(i);
+
+    da_free(ps.meshes);
+    da_free(ps.meshes_free_idx);
+    idx_hash_map_destroy(ps.meshes_lut);
+}
+
+const Vec3& physics_get_position(PhysicsWorld* w, u32 object_idx)
+{
+    return w->positions[w->object_slots[object_idx]];
+}
+
+const Quat& physics_get_rotation(PhysicsWorld* w, u32 object_idx)
+{
+    return w->rotations[w->object_slots[object_idx]];
+}
+
+Vec3 physics_get_interpolated_position(PhysicsWorld* w, u32 object_idx)
+{
+    let slot = w->object_slots[object_idx];
+    return lerp(w->prev_positions[slot], w->positions[slot], w->interpolation_alpha);
+}
+
+Quat physics_get_interpolated_rotation(PhysicsWorld* w, u32 object_idx)
+{
+    let slot = w->object_slots[object_idx];
+    return nlerp(w->prev_rotations[slot], w->rotations[slot], w->interpolation_alpha);
+}
+
+PhysicsRigidbodyStates physics_get_rigidbody_states(PhysicsWorld* w)
+{
+    return {
+        .num = w->rigidbody_slots_num,
+        .object_indices = w->slot_objects,
+        .positions = w->positions,
+        .rotations = w->rotations,
+        .prev_positions = w->prev_positions,
+        .prev_rotations = w->prev_rotations,
+        .sleeping = w->sleeping,
+        .interpolation_alpha = w->interpolation_alpha
+    };
+}
+
+const PhysicsStats& physics_get_stats(PhysicsWorld* w)
+{
+    return w->stats;
+}
+
+#define RAYCAST_TOLERANCE 0.001f
+#define RAYCAST_MAX_ITERATIONS 32
+
+static bool ray_hits_aabb(const Vec3& origin, const Vec3& inv_dir, f32 max_t, const Aabb& b)
+{
+    Vec3 t1 = {(b.min.x - origin.x) * inv_dir.x, (b.min.y - origin.y) * inv_dir.y, (b.min.z - origin.z) * inv_dir.z};
+    Vec3 t2 = {(b.max.x - origin.x) * inv_dir.x, (b.max.y - origin.y) * inv_dir.y, (b.max.z - origin.z) * inv_dir.z};
+    let t_enter = fmaxf(fmaxf(fminf(t1.x, t2.x), fminf(t1.y, t2.y)), fminf(t1.z, t2.z));
+    let t_exit = fminf(fminf(fmaxf(t1.x, t2.x), fmaxf(t1.y, t2.y)), fmaxf(t1.z, t2.z));
+    return t_enter <= t_exit && t_exit >= 0 && t_enter <= max_t;
+}
+
+// Conservative advancement of a point, as in shape_time_of_impact.
+static f32 ray_vs_shape(const GjkShape& shape, const Vec3& origin, const Vec3& dir, f32 max_t, Vec3* normal)
+{
+    GjkShape point = {.pos = origin, .rot = quat_identity(), .type = GJK_SHAPE_TYPE_SPHERE, .radius = 0};
+    f32 t = 0;
+
+    for (u32 i = 0; i < RAYCAST_MAX_ITERATIONS; ++i)
+    {
+        Vec3 n;
+        let d = gjk_distance(point, shape, &n);
+
+        if (d <= 0)
+        {
+            if (i == 0)
+                *normal = -dir;
+
+            return t;
+        }
+
+        *normal = n;
+
+        if (d < RAYCAST_TOLERANCE)
+            return t;
+
+        let closing_speed = -dot(dir, n);
+
+        if (closing_speed <= 0)
+            return -1;
+
+        t += d / closing_speed;
+
+        if (t > max_t)
+            return -1;
+
+        point.pos = origin + dir * t;
+    }
+
+    return t;
+}
+
+// Two sided, normal faces against dir.
+static f32 ray_vs_triangle(const Vec3& origin, const Vec3& dir, const Vec3* t, f32 max_t, Vec3* normal)
+{
+    let e1 = t[1] - t[0];
+    let e2 = t[2] - t[0];
+    let p = cross(dir, e2);
+    let det = dot(e1, p);
+
+    if (fabsf(det) < 0.0000001f)
+        return -1;
+
+    let inv_det = 1 / det;
+    let o = origin - t[0];
+    let u = dot(o, p) * inv_det;
+
+    if (u < 0 || u > 1)
+        return -1;
+
+    let q = cross(o, e1);
+    let v = dot(dir, q) * inv_det;
+
+    if (v < 0 || u + v > 1)
+        return -1;
+
+    let dist = dot(e2, q) * inv_det;
+
+    if (dist < 0 || dist > max_t)
+        return -1;
+
+    let n = normalize(cross(e1, e2));
+    *normal = dot(n, dir) > 0 ? -n : n;
+    return dist;
+}
+
+// Nearest triangle hit in the local space of the mesh.
+static f32 ray_vs_triangle_mesh(const PhysicsMesh* m, const Vec3& origin, const Vec3& dir, f32 max_t, Vec3* normal)
+{
+    Vec3 inv_dir = {1 / dir.x, 1 / dir.y, 1 / dir.z};
+    u32 stack[BVH_MAX_STACK];
+    u32 stack_num = 0;
+    stack[stack_num++] = 0;
+    f32 nearest = -1;
+
+    while (stack_num > 0)
+    {
+        let n = m->bvh + stack[--stack_num];
+
+        if (!ray_hits_aabb(origin, inv_dir, nearest < 0 ? max_t : nearest, n->bounds))
+            continue;
+
+        if (n->num == 0)
+        {
+            check(stack_num + 2 <= BVH_MAX_STACK, "BVH of %s is too deep", m->filename);
+            stack[stack_num++] = n->first + 1;
+            stack[stack_num++] = n->first;
+            continue;
+        }
+
+        for (u32 i = n->first; i < n->first + n->num; ++i)
+        {
+            Vec3 tn;
+            let t = ray_vs_triangle(origin, dir, m->triangles + i * 3, nearest < 0 ? max_t : nearest, &tn);
+
+            if (t >= 0 && (nearest < 0 || t < nearest))
+            {
+                nearest = t;
+                *normal = tn;
+            }
+        }
+    }
+
+    return nearest;
+}
+
+// Distance along unit dir to the first point of o, negative if it's missed.
+static f32 ray_vs_object(const PhysicsWorld* w, const PhysicsObject* o, const Vec3& origin, const Vec3& dir, f32 max_t, Vec3* normal)
+{
+    let c = o->collider;
+    let slot = w->object_slots[o->idx];
+    let pos = w->positions[slot];
+    let rot = w->rotations[slot];
+
+    switch(c.type)
+    {
+        case PHYSICS_COLLIDER_TYPE_SPHERE: {
+            let m = origin - pos;
+            let b = dot(m, dir);
+            let cc = dot(m, m) - c.radius * c.radius;
+
+            if (cc <= 0)
+            {
+                *normal = -dir;
+                return 0;
+            }
+
+            let disc = b * b - cc;
+
+            if (b > 0 || disc < 0)
+                return -1;
+
+            let t = -b - sqrtf(disc);
+            *normal = normalize(origin + dir * t - pos);
+            return t;
+        }
+
+        case PHYSICS_COLLIDER_TYPE_BOX: {
+            let inv_rot = inverse(rot);
+            let lo = rotate_vec3(inv_rot, origin - pos);
+            let ld = rotate_vec3(inv_rot, dir);
+            f32 lo_a[] = {lo.x, lo.y, lo.z};
+            f32 ld_a[] = {ld.x, ld.y, ld.z};
+            f32 e_a[] = {c.half_extents.x, c.half_extents.y, c.half_extents.z};
+            f32 t_enter = 0;
+            f32 t_exit = max_t;
+            i32 enter_axis = -1;
+            f32 enter_sign = 0;
+
+            for (i32 i = 0; i < 3; ++i)
+            {
+                if (fabsf(ld_a[i]) < 0.0000001f)
+                {
+                    if (fabsf(lo_a[i]) > e_a[i])
+                        return -1;
+
+                    continue;
+                }
+
+                let inv = 1 / ld_a[i];
+                f32 t1 = (-e_a[i] - lo_a[i]) * inv;
+                f32 t2 = (e_a[i] - lo_a[i]) * inv;
+                f32 sign = -1;
+
+                if (t1 > t2)
+                {
+                    let tmp = t1;
+                    t1 = t2;
+                    t2 = tmp;
+                    sign = 1;
+                }
+
+                if (t1 > t_enter)
+                {
+                    t_enter = t1;
+                    enter_axis = i;
+                    enter_sign = sign;
+                }
+
+                t_exit = fminf(t_exit, t2);
+
+                if (t_enter > t_exit)
+                    return -1;
+            }
+
+            if (enter_axis == -1)
+            {
+                *normal = -dir;
+                return 0;
+            }
+
+            Vec3 ln = {enter_axis == 0 ? enter_sign : 0, enter_axis == 1 ? enter_sign : 0, enter_axis == 2 ? enter_sign : 0};
+            *normal = rotate_vec3(rot, ln);
+            return t_enter;
+        }
+
+        case PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH: {
+            let inv_rot = inverse(rot);
+            Vec3 ln = vec3_zero;
+            let t = ray_vs_triangle_mesh(ps.meshes + c.mesh_idx, rotate_vec3(inv_rot, origin - pos), rotate_vec3(inv_rot, dir), max_t, &ln);
+            *normal = rotate_vec3(rot, ln);
+            return t;
+        }
+
+        case PHYSICS_COLLIDER_TYPE_PLANE: {
+            let n = rotate_vec3(rot, vec3_up);
+            let dist = dot(n, origin - pos);
+            *normal = n;
+
+            if (dist <= 0)
+                return 0;
+
+            let denom = dot(n, dir);
+
+            if (denom >= 0)
+                return -1;
+
+            return -dist / denom;
+        }
+
+        default: break;
+    }
+
+    // Meshes and capsules, nearest hit of any hull.
+    f32 nearest = -1;
+
+    for (u32 h = 0; h < collider_hulls_num(c); ++h)
+    {
+        Vec3 n = vec3_zero;
+        let t = ray_vs_shape(object_gjk_shape(w, o, h), origin, dir, nearest < 0 ? max_t : nearest, &n);
+
+        if (t >= 0 && (nearest < 0 || t < nearest))
+        {
+            nearest = t;
+            *normal = n;
+        }
+    }
+
+    return nearest;
+}
+
+// Per ray part of a batch, kept between objects of the shared broadphase pass.
+struct RaycastState
+{
+    Vec3 dir;
+    Vec3 inv_dir;
+    f32 min_x;
+    f32 max_x;
+    f32 closest;
+};
+
+#define RAYCAST_BATCH_SIZE 64
+
+bool physics_raycast(const PhysicsWorld* w, const PhysicsRay& ray, PhysicsRaycastHit* hit)
+{
+    physics_raycast_batch(w, &ray, 1, hit);
+    return hit->object_idx != 0;
+}
+
+void physics_raycast_batch(const PhysicsWorld* w, const PhysicsRay* rays, u32 rays_num, PhysicsRaycastHit* hits)
+{
+    let sorted = w->broadphase_sorted;
+
+    // Fixed size chunks keep the per ray state on the stack, queries don't allocate.
+    for (u32 first = 0; first < rays_num; first += RAYCAST_BATCH_SIZE)
+    {
+        let num = rays_num - first < RAYCAST_BATCH_SIZE ? rays_num - first : RAYCAST_BATCH_SIZE;
+        RaycastState states[RAYCAST_BATCH_SIZE];
+        f32 batch_min_x = 0;
+        f32 batch_max_x = 0;
+
+        for (u32 i = 0; i < num; ++i)
+        {
+            let ray = rays + first + i;
+            let rs = states + i;
+            let dir = normalize(ray->dir);
+            let end = ray->origin + dir * ray->max_distance;
+
+            *rs = {
+                .dir = dir,
+                .inv_dir = {1 / dir.x, 1 / dir.y, 1 / dir.z},
+                .min_x = fminf(ray->origin.x, end.x),
+                .max_x = fmaxf(ray->origin.x, end.x),
+                .closest = ray->max_distance
+            };
+
+            hits[first + i] = {};
+            batch_min_x = i == 0 ? rs->min_x : fminf(batch_min_x, rs->min_x);
+            batch_max_x = i == 0 ? rs->max_x : fmaxf(batch_max_x, rs->max_x);
+        }
+
+        // One pass over broadphase for the whole chunk, objects outside the
+        // x range of every ray are skipped once instead of once per ray.
+        for (u32 sorted_idx = 0; sorted_idx < da_num(sorted); ++sorted_idx)
+        {
+            let o = w->objects + sorted[sorted_idx];
+
+            if (o->aabb.min.x > batch_max_x)
+                break;
+
+            if (o->aabb.max.x < batch_min_x)
+                continue;
+
+            for (u32 i = 0; i < num; ++i)
+            {
+                let ray = rays + first + i;
+                let rs = states + i;
+
+                if (o->aabb.min.x > rs->max_x || o->aabb.max.x < rs->min_x || o->idx == ray->ignore_object_idx || !ray_hits_aabb(ray->origin, rs->inv_dir, rs->closest, o->aabb))
+                    continue;
+
+                Vec3 n = vec3_zero;
+                let t = ray_vs_object(w, o, ray->origin, rs->dir, rs->closest, &n);
+
+                if (t < 0 || t > rs->closest)
+                    continue;
+
+                rs->closest = t;
+
+                hits[first + i] = {
+                    .object_idx = o->idx,
+                    .distance = t,
+                    .point = ray->origin + rs->dir * t,
+                    .normal = n
+                };
+            }
+        }
+    }
+}
+
+static bool overlap_triangle(void* data, const Vec3* triangle)
+{
+    let q = (TriangleMeshQuery*)data;
+    q->overlaps = gjk_intersect(*q->shape, triangle_shape(q, triangle));
+    return !q->overlaps;
+}
+
+u32 physics_overlap_sphere(const PhysicsWorld* w, const Vec3& center, f32 radius, u32* object_indices, u32 object_indices_max)
+{
+    Vec3 e = {radius, radius, radius};
+    Aabb aabb = {.min = center - e, .max = center + e};
+    GjkShape sphere = {.pos = center, .rot = quat_identity(), .type = GJK_SHAPE_TYPE_SPHERE, .radius = radius};
+    let sorted = w->broadphase_sorted;
+    u32 num = 0;
+
+    for (u32 i = 0; i < da_num(sorted); ++i)
+    {
+        let o = w->objects + sorted[i];
+
+        if (o->aabb.min.x > aabb.max.x)
+            break;
+
+        if (!aabb_overlaps(aabb, o->aabb))
+            continue;
+
+        let collide = collide_pair_funcs[PHYSICS_COLLIDER_TYPE_SPHERE][o->collider.type];
+        bool overlaps = false;
+
+        if (o->collider.type == PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH)
+        {
+            let slot = w->object_slots[o->idx];
+            TriangleMeshQuery q = {.shape = &sphere, .pos = w->positions[slot], .rot = w->rotations[slot]};
+            visit_triangles(ps.meshes + o->collider.mesh_idx, world_aabb_to_local(aabb, q.pos, q.rot), overlap_triangle, &q);
+            overlaps = q.overlaps;
+        }
+        else
+        {
+            for (u32 h = 0; h < collider_hulls_num(o->collider) && !overlaps; ++h)
+            {
+                let shape = object_gjk_shape(w, o, h);
+                overlaps = collide ? collide(sphere, shape).colliding : gjk_intersect(sphere, shape);
+            }
+        }
+
+        if (!overlaps)
+            continue;
+
+        if (num < object_indices_max)
+            object_indices[num] = o->idx;
+
+        ++num;
+    }
+
+    return num;
+}
+
+void physics_start_recording(PhysicsWorld* w)
+{
+    check(w->deterministic, "Recordings only replay the same in deterministic mode");
+    check(!w->recording, "Physics world is already recording");
+    check(da_num(w->objects) == 1, "Recording has to start with an empty world");
+
+    PhysicsRecordingHeader h = {
+        .magic = PHYSICS_RECORDING_MAGIC,
+        .version = PHYSICS_RECORDING_VERSION,
+        .fixed_dt = w->fixed_dt,
+        .solver_iterations = w->solver_iterations
+    };
+
+    w->recording = true;
+    da_clear(w->recording_data);
+    da_clear(w->recorded_meshes);
+    record_bytes(w, &h, sizeof(h));
+}
+
+bool physics_stop_recording(PhysicsWorld* w, const char* filename)
+{
+    check(w->recording, "Physics world isn't recording");
+    w->recording = false;
+    let ok = file_write(filename, w->recording_data, da_num(w->recording_data));
+    da_free(w->recording_data);
+    da_free(w->recorded_meshes);
+    return ok;
+}
+
+struct PhysicsReplay
+{
+    PhysicsWorld* world;
+    u8* data;
+    u64 data_size;
+    u64 offset;
+    u32* meshes; // dynamic, mesh index in the recording -> loaded mesh index
+};
+
+PhysicsReplay* physics_replay_load(const char* filename)
+{
+    let flr = file_load(filename);
+
+    if (!flr.ok)
+        return NULL;
+
+    PhysicsRecordingHeader h = {};
+
+    if (flr.data_size >= sizeof(h))
+        memcpy(&h, flr.data, sizeof(h));
+
+    check(h.magic == PHYSICS_RECORDING_MAGIC && h.version == PHYSICS_RECORDING_VERSION, "%s isn't a physics recording of version %u", filename, PHYSICS_RECORDING_VERSION);
+
+    let r = mema_zero_t(PhysicsReplay);
+    r->data = (u8*)flr.data;
+    r->data_size = flr.data_size;
+    r->offset = sizeof(h);
+    r->world = physics_create_world();
+    r->world->deterministic = true;
+    r->world->fixed_dt = h.fixed_dt;
+    r->world->solver_iterations = h.solver_iterations;
+    return r;
+}
+
+PhysicsWorld* physics_replay_world(PhysicsReplay* r)
+{
+    return r->world;
+}
+
+bool physics_replay_step(PhysicsReplay* r)
+{
+    let w = r->world;
+
+    while (r->offset + 2 * sizeof(u32) <= r->data_size)
+    {
+        u32 event_header[2];
+        memcpy(event_header, r->data + r->offset, sizeof(event_header));
+        let type = event_header[0];
+        let size = event_header[1];
+        let payload = r->data + r->offset + sizeof(event_header);
+        check(r->offset + sizeof(event_header) + size <= r->data_size, "Physics recording is truncated");
+        r->offset += sizeof(event_header) + size;
+
+        switch(type)
+        {
+            case PHYSICS_RECORD_EVENT_LOAD_MESH: {
+                u32 recorded_idx;
+                memcpy(&recorded_idx, payload, sizeof(u32));
+                let filename = str_copy_s((const char*)payload + sizeof(u32), size - sizeof(u32));
+
+                while (da_num(r->meshes) <= recorded_idx)
+                    da_push(r->meshes, 0u);
+
+                r->meshes[recorded_idx] = physics_load_mesh(filename);
+                memf(filename);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_CREATE_OBJECT: {
+                RecordedObject ro;
+                memcpy(&ro, payload, sizeof(ro));
+
+                if (collider_uses_mesh(ro.collider))
+                    ro.collider.mesh_idx = r->meshes[ro.collider.mesh_idx];
+
+                let idx = physics_create_object(w, ro.collider, ro.render_object_idx, ro.pos, ro.rot, ro.material);
+                check(idx == ro.object_idx, "Replay created object %u, recording has %u", idx, ro.object_idx);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_CREATE_RIGIDBODY: {
+                RecordedRigidbody rr;
+                memcpy(&rr, payload, sizeof(rr));
+                let idx = physics_create_rigidbody(w, rr.object_idx, rr.mass, rr.velocity);
+                check(idx == rr.rigidbody_idx, "Replay created rigidbody %u, recording has %u", idx, rr.rigidbody_idx);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_SET_CCD: {
+                RecordedValue rv;
+                memcpy(&rv, payload, sizeof(rv));
+                physics_set_ccd(w, rv.idx, rv.value);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_SET_VELOCITY: {
+                RecordedVector rv;
+                memcpy(&rv, payload, sizeof(rv));
+                physics_set_velocity(w, rv.idx, rv.v);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_ADD_FORCE: {
+                RecordedVector rv;
+                memcpy(&rv, payload, sizeof(rv));
+                physics_add_force(w, rv.idx, rv.v);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_ADD_TORQUE: {
+                RecordedTorque rt;
+                memcpy(&rt, payload, sizeof(rt));
+                physics_add_torque(w, rt.rigidbody_idx, rt.pivot, rt.point, rt.force);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_SET_POSITION: {
+                RecordedPosition rp;
+                memcpy(&rp, payload, sizeof(rp));
+                physics_set_position(w, rp.object_idx, rp.pos, rp.rot);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_SET_SOLVER_ITERATIONS: {
+                RecordedValue rv;
+                memcpy(&rv, payload, sizeof(rv));
+                physics_set_solver_iterations(w, rv.value);
+            } break;
+
+            case PHYSICS_RECORD_EVENT_UPDATE:
+                physics_update_world(w);
+                return true;
+
+            default: error("Unknown event %u in physics recording", type);
+        }
+    }
+
+    return false;
+}
+
+void physics_replay_destroy(PhysicsReplay* r)
+{
+    physics_destroy_world(r->world);
+    da_free(r->meshes);
+    memf(r->data);
+    memf(r);
+}
+
+// FNV-1a
+static u64 hash_bytes(u64 h, const void* data, u64 size)
+{
+    for (u64 i = 0; i < size; ++i)
+        h = (h ^ ((const u8*)data)[i]) * 1099511628211ull;
+
+    return h;
+}
+
+u64 physics_get_state_hash(PhysicsWorld* w)
+{
+    let slots_num = da_num(w->positions);
+    u64 h = 14695981039346656037ull;
+    h = hash_bytes(h, w->slot_objects, slots_num * sizeof(u32));
+    h = hash_bytes(h, w->positions, slots_num * sizeof(Vec3));
+    h = hash_bytes(h, w->rotations, slots_num * sizeof(Quat));
+    h = hash_bytes(h, w->velocities, slots_num * sizeof(Vec3));
+    h = hash_bytes(h, w->angular_velocities, slots_num * sizeof(Vec3));
+    return h;
+}
+
+
+// Snapshots are a header followed by the arrays below, back to back in this
+// order. Everything in them is plain data indexed by handle or slot, so a
+// snapshot copies without fixups.
+enum PhysicsSnapshotArray
+{
+    PHYSICS_SNAPSHOT_ARRAY_OBJECTS,
+    PHYSICS_SNAPSHOT_ARRAY_OBJECTS_FREE_IDX,
+    PHYSICS_SNAPSHOT_ARRAY_RIGIDBODIES,
+    PHYSICS_SNAPSHOT_ARRAY_RIGIDBODIES_FREE_IDX,
+    PHYSICS_SNAPSHOT_ARRAY_OBJECT_SLOTS,
+    PHYSICS_SNAPSHOT_ARRAY_SLOT_OBJECTS,
+    PHYSICS_SNAPSHOT_ARRAY_POSITIONS,
+    PHYSICS_SNAPSHOT_ARRAY_ROTATIONS,
+    PHYSICS_SNAPSHOT_ARRAY_PREV_POSITIONS,
+    PHYSICS_SNAPSHOT_ARRAY_PREV_ROTATIONS,
+    PHYSICS_SNAPSHOT_ARRAY_VELOCITIES,
+    PHYSICS_SNAPSHOT_ARRAY_ANGULAR_VELOCITIES,
+    PHYSICS_SNAPSHOT_ARRAY_SLEEPING,
+    PHYSICS_SNAPSHOT_ARRAY_BROADPHASE_SORTED,
+    PHYSICS_SNAPSHOT_ARRAY_PAIRS, // caches and manifolds, next update warm starts from them
+    PHYSICS_SNAPSHOT_ARRAY_NUM
+};
+
+struct PhysicsSnapshotHeader
+{
+    u64 size;
+    u32 arrays_num[PHYSICS_SNAPSHOT_ARRAY_NUM];
+    u32 rigidbody_slots_num;
+    f32 accumulator;
+    f32 interpolation_alpha;
+};
+
+struct SnapshotArray
+{
+    void** data; // dynamic array
+    u32 item_size;
+};
+
+static void get_snapshot_arrays(PhysicsWorld* w, SnapshotArray* arrays)
+{
+    arrays[PHYSICS_SNAPSHOT_ARRAY_OBJECTS] = {(void**)&w->objects, sizeof(PhysicsObject)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_OBJECTS_FREE_IDX] = {(void**)&w->objects_free_idx, sizeof(u32)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_RIGIDBODIES] = {(void**)&w->rigidbodies, sizeof(Rigidbody)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_RIGIDBODIES_FREE_IDX] = {(void**)&w->rigidbodies_free_idx, sizeof(u32)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_OBJECT_SLOTS] = {(void**)&w->object_slots, sizeof(u32)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_SLOT_OBJECTS] = {(void**)&w->slot_objects, sizeof(u32)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_POSITIONS] = {(void**)&w->positions, sizeof(Vec3)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_ROTATIONS] = {(void**)&w->rotations, sizeof(Quat)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_PREV_POSITIONS] = {(void**)&w->prev_positions, sizeof(Vec3)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_PREV_ROTATIONS] = {(void**)&w->prev_rotations, sizeof(Quat)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_VELOCITIES] = {(void**)&w->velocities, sizeof(Vec3)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_ANGULAR_VELOCITIES] = {(void**)&w->angular_velocities, sizeof(Vec3)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_SLEEPING] = {(void**)&w->sleeping, sizeof(bool)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_BROADPHASE_SORTED] = {(void**)&w->broadphase_sorted, sizeof(u32)};
+    arrays[PHYSICS_SNAPSHOT_ARRAY_PAIRS] = {(void**)&w->pairs, sizeof(PhysicsPair)};
+}
+
+u64 physics_snapshot_size(PhysicsWorld* w)
+{
+    SnapshotArray arrays[PHYSICS_SNAPSHOT_ARRAY_NUM];
+    get_snapshot_arrays(w, arrays);
+    u64 size = sizeof(PhysicsSnapshotHeader);
+
+    for (u32 i = 0; i < PHYSICS_SNAPSHOT_ARRAY_NUM; ++i)
+        size += (u64)da_num(*arrays[i].data) * arrays[i].item_size;
+
+    return size;
+}
+
+u64 physics_snapshot(PhysicsWorld* w, void* buffer, u64 buffer_size)
+{
+    let size = physics_snapshot_size(w);
+
+    if (size > buffer_size)
+        return size;
+
+    SnapshotArray arrays[PHYSICS_SNAPSHOT_ARRAY_NUM];
+    get_snapshot_arrays(w, arrays);
+
+    PhysicsSnapshotHeader h = {
+        .size = size,
+        .rigidbody_slots_num = w->rigidbody_slots_num,
+        .accumulator = w->accumulator,
+        .interpolation_alpha = w->interpolation_alpha
+    };
+
+    let dest = (u8*)buffer + sizeof(h);
+
+    for (u32 i = 0; i < PHYSICS_SNAPSHOT_ARRAY_NUM; ++i)
+    {
+        let num = da_num(*arrays[i].data);
+        let array_size = (u64)num * arrays[i].item_size;
+        h.arrays_num[i] = num;
+
+        if (array_size > 0)
+            memcpy(dest, *arrays[i].data, array_size);
+
+        dest += array_size;
+    }
+
+    memcpy(buffer, &h, sizeof(h));
+    return size;
+}
+
+void physics_restore(PhysicsWorld* w, const void* buffer)
+{
+    check(!w->recording, "Can't restore a snapshot while recording");
+    PhysicsSnapshotHeader h;
+    memcpy(&h, buffer, sizeof(h));
+    SnapshotArray arrays[PHYSICS_SNAPSHOT_ARRAY_NUM];
+    get_snapshot_arrays(w, arrays);
+    let src = (const u8*)buffer + sizeof(h);
+
+    for (u32 i = 0; i < PHYSICS_SNAPSHOT_ARRAY_NUM; ++i)
+    {
+        let a = arrays[i].data;
+        let num = h.arrays_num[i];
+        let array_size = (u64)num * arrays[i].item_size;
+
+        // Arrays keep their capacity, restoring many times doesn't allocate.
+        if (num > da_cap(*a))
+            *a = da__grow_func(*a, num, arrays[i].item_size);
+
+        if (*a)
+            da__num(*a) = num;
+
+        if (array_size > 0)
+            memcpy(*a, src, array_size);
+
+        src += array_size;
+    }
+
+    check((u64)(src - (const u8*)buffer) == h.size, "Physics snapshot is corrupt");
+    w->rigidbody_slots_num = h.rigidbody_slots_num;
+    w->accumulator = h.accumulator;
+    w->interpolation_alpha = h.interpolation_alpha;
+    da_clear(w->pairs_prev);
 }
\ No newline at end of file
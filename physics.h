@@ -1,12 +1,34 @@
 #pragma once
+#include "math.h"
 
-fwd_struct(Vec3);
-fwd_struct(Quat);
 fwd_struct(PhysicsWorld);
+fwd_struct(PhysicsReplay);
 
+enum PhysicsColliderType
+{
+    PHYSICS_COLLIDER_TYPE_MESH,
+    PHYSICS_COLLIDER_TYPE_SPHERE,
+    PHYSICS_COLLIDER_TYPE_BOX,
+    PHYSICS_COLLIDER_TYPE_CAPSULE,
+    PHYSICS_COLLIDER_TYPE_PLANE,
+    PHYSICS_COLLIDER_TYPE_TRIANGLE_MESH,
+    PHYSICS_COLLIDER_TYPE_NUM
+};
+
+// Primitives are centered on their object. Capsules run along local z.
+// Planes face local +z through the object position and are solid behind,
+// use them for static objects only. Pairs of primitives have closed-form
+// tests, anything involving a mesh goes through GJK/EPA. Triangle meshes
+// collide with the triangles of a mesh instead of its hulls, so they can be
+// concave level geometry. They are static only, like planes, and are only
+// tested where a BVH over their triangles overlaps the other object.
 struct PhysicsCollider
 {
-    u32 mesh_idx;
+    PhysicsColliderType type;
+    u32 mesh_idx; // mesh
+    f32 radius; // sphere and capsule
+    f32 half_height; // capsule, center to end cap center
+    Vec3 half_extents; // box
 };
 
 struct PhysicsMaterial
@@ -15,20 +37,134 @@ struct PhysicsMaterial
     f32 elasticity;
 };
 
+// Counters for the latest physics_update_world that ran a step, summed over
+// its substeps.
+struct PhysicsStats
+{
+    u32 substeps;
+    u32 pairs_brute_force; // pairs a test of every rigidbody against every object would run
+    u32 pairs_tested; // pairs that passed broadphase and ran narrowphase
+    u32 pairs_colliding;
+    u32 pairs_reused; // tested pairs that hadn't moved relative to each other, result came from cache
+    u32 contacts; // manifold points the solver worked on
+    u32 gjk_iterations;
+    u32 epa_iterations;
+    u32 rigidbodies_sleeping;
+    u32 ccd_hits; // steps where continuous collision detection stopped a rigidbody early
+};
+
+struct PhysicsRay
+{
+    Vec3 origin;
+    Vec3 dir; // any length above zero
+    f32 max_distance;
+    u32 ignore_object_idx; // zero ignores nothing
+};
+
+struct PhysicsRaycastHit
+{
+    u32 object_idx; // zero if nothing was hit
+    f32 distance; // along the ray, zero if it starts inside the object
+    Vec3 point;
+    Vec3 normal;
+};
+
+// Simulated state of all rigidbodies, stored densely so it can be copied
+// out in one pass. Pointers stay valid until objects or rigidbodies are created.
+struct PhysicsRigidbodyStates
+{
+    u32 num;
+    const u32* object_indices;
+    const Vec3* positions;
+    const Quat* rotations;
+    const Vec3* prev_positions;
+    const Quat* prev_rotations;
+    const bool* sleeping;
+    f32 interpolation_alpha;
+};
+
 void physics_init();
 void physics_shutdown();
 
 PhysicsCollider physics_create_collider(u32 mesh_idx);
+PhysicsCollider physics_create_sphere_collider(f32 radius);
+PhysicsCollider physics_create_box_collider(const Vec3& half_extents);
+// Box the size of the mesh's bounds. The mesh has to be centered on its
+// origin, since boxes are centered on their object.
+PhysicsCollider physics_create_box_collider_from_mesh(u32 mesh_idx);
+PhysicsCollider physics_create_capsule_collider(f32 radius, f32 half_height);
+PhysicsCollider physics_create_plane_collider();
+PhysicsCollider physics_create_triangle_mesh_collider(u32 mesh_idx);
 PhysicsWorld* physics_create_world();
 void physics_destroy_world(PhysicsWorld* w);
+
+// Makes physics_update_world step with a fixed dt, running as many steps
+// as time_dt() allows but at most max_substeps. Leftover time carries
+// over and physics_get_interpolated_* blend between the last two states.
+// A rate of zero goes back to one step of time_dt() per update.
+void physics_set_fixed_timestep(PhysicsWorld* w, f32 steps_per_second, u32 max_substeps);
+// More iterations make stacks stiffer, default is 8.
+void physics_set_solver_iterations(PhysicsWorld* w, u32 iterations);
+// Every physics_update_world runs exactly one step of 1/steps_per_second
+// without looking at time_dt(). Given the same calls in the same order the
+// results are bit identical between runs, which recordings rely on.
+void physics_set_deterministic(PhysicsWorld* w, f32 steps_per_second);
 u32 physics_load_mesh(const char* filename);
 void physics_destroy_mesh(u32 mesh_idx);
 u32 physics_create_object(PhysicsWorld* w, const PhysicsCollider& collider, u32 render_object_idx, const Vec3& pos, const Quat& rot, const PhysicsMaterial& = {});
 u32 physics_create_rigidbody(PhysicsWorld* w, u32 object_idx, f32 mass, const Vec3& velocity);
+// With CCD on, a rigidbody moving more than half its size in one step is
+// swept against what broadphase found near it and stops where it would
+// first touch, so it can't pass through thin objects. Only translation is
+// swept, rotation is applied as usual.
+void physics_set_ccd(PhysicsWorld* w, u32 rigidbody_idx, bool enabled);
 void physics_set_velocity(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& vel);
 void physics_add_force(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& f);
 void physics_add_torque(PhysicsWorld* w, u32 rigidbody_idx, const Vec3& pivot, const Vec3& point, const Vec3& force);
 void physics_set_position(PhysicsWorld* w, u32 object_idx, const Vec3& pos, const Quat& rot);
 const Vec3& physics_get_position(PhysicsWorld* w, u32 object_idx);
 const Quat& physics_get_rotation(PhysicsWorld* w, u32 object_idx);
-void physics_update_world(PhysicsWorld* w);
\ No newline at end of file
+Vec3 physics_get_interpolated_position(PhysicsWorld* w, u32 object_idx);
+Quat physics_get_interpolated_rotation(PhysicsWorld* w, u32 object_idx);
+bool physics_is_sleeping(PhysicsWorld* w, u32 rigidbody_idx);
+PhysicsRigidbodyStates physics_get_rigidbody_states(PhysicsWorld* w);
+void physics_update_world(PhysicsWorld* w);
+const PhysicsStats& physics_get_stats(PhysicsWorld* w);
+// Changes with any bit of any position, rotation or velocity, for checking
+// that two runs simulated the same thing.
+u64 physics_get_state_hash(PhysicsWorld* w);
+
+// Records every call that changes the world, up to physics_stop_recording
+// which writes it to filename. The world has to be empty and deterministic
+// when recording starts.
+void physics_start_recording(PhysicsWorld* w);
+bool physics_stop_recording(PhysicsWorld* w, const char* filename);
+
+// Replays a recording into a world of its own, loading the meshes it names.
+// Each physics_replay_step does the recorded calls up to and including the
+// next physics_update_world, false means the recording has ended.
+PhysicsReplay* physics_replay_load(const char* filename);
+PhysicsWorld* physics_replay_world(PhysicsReplay* r);
+bool physics_replay_step(PhysicsReplay* r);
+void physics_replay_destroy(PhysicsReplay* r);
+
+// Copies the simulated state of the world into buffer as one flat blob, for
+// rolling back and simulating again. Returns the size it needs, nothing is
+// written if buffer_size is less than that. Restoring only copies the blob
+// back, objects and rigidbodies created after the snapshot are gone again.
+// Step rate, solver iterations and meshes aren't part of snapshots.
+u64 physics_snapshot_size(PhysicsWorld* w);
+u64 physics_snapshot(PhysicsWorld* w, void* buffer, u64 buffer_size);
+void physics_restore(PhysicsWorld* w, const void* buffer);
+
+// Queries only read the world, so any number of threads can run them at
+// once as long as nothing updates or changes the world meanwhile. They
+// don't allocate and use the AABBs broadphase keeps to skip far objects.
+bool physics_raycast(const PhysicsWorld* w, const PhysicsRay& ray, PhysicsRaycastHit* hit);
+// Same hits as one physics_raycast per ray, but the rays share a pass over
+// broadphase, so many rays in the same area cost less than casting them one by one.
+void physics_raycast_batch(const PhysicsWorld* w, const PhysicsRay* rays, u32 rays_num, PhysicsRaycastHit* hits);
+
+// Writes at most object_indices_max of the objects overlapping the sphere
+// to object_indices and returns how many overlap in total.
+u32 physics_overlap_sphere(const PhysicsWorld* w, const Vec3& center, f32 radius, u32* object_indices, u32 object_indices_max);
\ No newline at end of file
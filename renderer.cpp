@@ -35,6 +35,7 @@ struct Pipeline
     RenderBackendPipeline* backend_state;
     PrimitiveTopology primitive_topology;
     bool depth_test;
+    bool instanced; // takes the model matrix per instance instead of as a push constant
 };
 
 struct RenderMesh
@@ -71,6 +72,9 @@ struct Renderer
     IdxHashMap* shaders_lut;
     u32 debug_draw_traingles_pipeline_idx;
     u32 debug_draw_line_pipeline_idx;
+    u32* mesh_instance_offsets; // dynamic, scratch for grouping world objects by mesh
+    Mat4* instance_models; // scratch, world object models grouped by mesh
+    u32 instance_models_cap;
 };
 
 static Renderer rs = {};
@@ -143,7 +147,7 @@ static void init_pipeline(u32 pipeline_idx)
         vertex_input_types, p->vertex_input_num,
         constant_buffer_sizes, constant_buffer_binding_indices, p->constant_buffers_num,
         push_constants_sizes, push_constants_shader_types, push_constants_num,
-        p->primitive_topology, p->depth_test);
+        p->primitive_topology, p->depth_test, p->instanced);
 
     da_free(push_constants_sizes);
     da_free(push_constants_shader_types);
@@ -467,6 +471,10 @@ u32 renderer_load_pipeline(const char* filename)
     check(jz_depth_test == NULL || jz_depth_test->is_bool, "depth_test must be a bool");
     p.depth_test = jz_depth_test == NULL || jz_depth_test->bool_val;
 
+    let jz_instanced = jzon_get(jpr.output, "instanced");
+    check(jz_instanced == NULL || jz_instanced->is_bool, "instanced must be a bool");
+    p.instanced = jz_instanced != NULL && jz_instanced->bool_val;
+
     jzon_free(&jpr.output);
 
     let idx = da_num(rs.pipelines_free_idx) > 0 ? da_pop(rs.pipelines_free_idx) : da_num(rs.pipelines);
@@ -528,6 +536,8 @@ void renderer_shutdown()
 
     da_free(rs.pipelines);
     da_free(rs.pipelines_free_idx);
+    da_free(rs.mesh_instance_offsets);
+    memf(rs.instance_models);
 
     idx_hash_map_destroy(rs.meshes_lut);
     idx_hash_map_destroy(rs.pipelines_lut);
@@ -592,11 +602,11 @@ static void populate_constant_buffers(const Pipeline& p, const Mat4& model_matri
             switch(cbf->auto_value)
             {
                 case CONSTANT_BUFFER_AUTO_VALUE_MAT_MODEL:
-                    renderer_backend_update_constant_buffer(*p.backend_state, cb->binding, &model_matrix, sizeof(model_matrix), offset);
+                    renderer_backend_update_constant_buffer(p.backend_state, cb->binding, &model_matrix, sizeof(model_matrix), offset);
                     break;
 
                 case CONSTANT_BUFFER_AUTO_VALUE_MAT_MODEL_VIEW_PROJECTION:
-                    renderer_backend_update_constant_buffer(*p.backend_state, cb->binding, &mvp_matrix, sizeof(mvp_matrix), offset);
+                    renderer_backend_update_constant_buffer(p.backend_state, cb->binding, &mvp_matrix, sizeof(mvp_matrix), offset);
                     break;
 
                 default: break;
@@ -617,28 +627,79 @@ void renderer_begin_frame(u32 pipeline_idx)
     renderer_backend_begin_frame(pipeline->backend_state);
 }
 
-void renderer_draw(u32 pipeline_idx, u32 mesh_idx, const Mat4& model, const Vec3& cam_pos, const Quat& cam_rot)
+static Mat4 get_view_projection(const Vec3& cam_pos, const Quat& cam_rot)
 {
     Mat4 camera_matrix = mat4_from_rotation_and_translation(cam_rot, cam_pos);
     Mat4 view_matrix = inverse(camera_matrix);
 
     Vec2u size = renderer_backend_get_size();
     Mat4 proj_matrix = mat4_create_projection_matrix(size.x, size.y);
-    Mat4 mvp_matrix = model * view_matrix * proj_matrix;
+    return view_matrix * proj_matrix;
+}
 
+void renderer_draw(u32 pipeline_idx, u32 mesh_idx, const Mat4& model, const Vec3& cam_pos, const Quat& cam_rot)
+{
     let pipeline = rs.pipelines + pipeline_idx;
-
-    renderer_backend_draw(pipeline->backend_state, rs.meshes[mesh_idx].backend_state, mvp_matrix, model);
+    check(pipeline->instanced, "renderer_draw needs an instanced pipeline");
+    renderer_backend_draw(pipeline->backend_state, rs.meshes[mesh_idx].backend_state, &model, 1, get_view_projection(cam_pos, cam_rot));
 }
 
 void renderer_draw_world(u32 pipeline_idx, RenderWorld* w, const Vec3& cam_pos, const Quat& cam_rot)
 {
+    let pipeline = rs.pipelines + pipeline_idx;
+    check(pipeline->instanced, "renderer_draw_world needs an instanced pipeline");
+
+    // Counting sort of the models by mesh, so each mesh is one instanced draw.
+    let meshes_num = da_num(rs.meshes);
+    da_clear(rs.mesh_instance_offsets);
+
+    for (u32 i = 0; i <= meshes_num; ++i)
+        da_push(rs.mesh_instance_offsets, 0u);
+
+    let offsets = rs.mesh_instance_offsets;
+    u32 instances_num = 0;
+
+    da_foreach(obj, w->objects)
+    {
+        if (!obj->idx)
+            continue;
+
+        ++offsets[obj->mesh_idx + 1];
+        ++instances_num;
+    }
+
+    if (instances_num == 0)
+        return;
+
+    for (u32 i = 1; i <= meshes_num; ++i)
+        offsets[i] += offsets[i - 1];
+
+    if (instances_num > rs.instance_models_cap)
+    {
+        rs.instance_models = memra_tn(rs.instance_models, Mat4, instances_num);
+        rs.instance_models_cap = instances_num;
+    }
+
+    // Bumps offsets[m] up to where mesh m ends, which is where mesh m + 1 starts.
     da_foreach(obj, w->objects)
     {
         if (!obj->idx)
             continue;
 
-        renderer_draw(pipeline_idx, obj->mesh_idx, obj->model, cam_pos, cam_rot);
+        rs.instance_models[offsets[obj->mesh_idx]++] = obj->model;
+    }
+
+    let view_projection = get_view_projection(cam_pos, cam_rot);
+    u32 start = offsets[0]; // skips objects without mesh
+
+    for (u32 mesh_idx = 1; mesh_idx < meshes_num; ++mesh_idx)
+    {
+        let end = offsets[mesh_idx];
+
+        if (end > start)
+            renderer_backend_draw(pipeline->backend_state, rs.meshes[mesh_idx].backend_state, rs.instance_models + start, end - start, view_projection);
+
+        start = end;
     }
 }
 
@@ -647,6 +708,16 @@ void renderer_present()
     renderer_backend_present();
 }
 
+const RendererFrameTimings& renderer_get_frame_timings()
+{
+    return renderer_backend_get_frame_timings();
+}
+
+RendererMemoryStats renderer_get_memory_stats()
+{
+    return renderer_backend_get_memory_stats();
+}
+
 void renderer_surface_resized(u32 w, u32 h)
 {
     info("Render resizing to %d x %d", w, h);
@@ -678,12 +749,7 @@ static u32 get_pipeline_for_topology(PrimitiveTopology pt)
 
 void renderer_debug_draw(const Vec3* vertices, u32 vertices_num, const Vec4* colors, PrimitiveTopology pt, const Vec3& cam_pos, const Quat& cam_rot)
 {
-    Mat4 camera_matrix = mat4_from_rotation_and_translation(cam_rot, cam_pos);
-    Mat4 view_matrix = inverse(camera_matrix);
-
-    Vec2u size = renderer_backend_get_size();
-    Mat4 proj_matrix = mat4_create_projection_matrix(size.x, size.y);
-    Mat4 vp_matrix = view_matrix * proj_matrix;
+    Mat4 vp_matrix = get_view_projection(cam_pos, cam_rot);
 
     Vec4 white = {1,1,1,1};
     SimpleVertex* mesh = mema_tn(SimpleVertex, vertices_num);
@@ -18,6 +18,31 @@ enum WindowType : u32
     WINDOW_TYPE_X11
 };
 
+// The CPU records a frame while the GPU still draws earlier ones, wait_ms
+// staying near zero while gpu_ms is above zero means the two overlap. gpu_ms
+// is from the latest frame the GPU finished, which lags a couple of frames.
+struct RendererFrameTimings
+{
+    f32 frame_ms; // between the last two begin_frames
+    f32 cpu_ms; // begin_frame to end of present, without wait_ms
+    f32 wait_ms; // begin_frame blocked on the GPU finishing an older frame
+    f32 gpu_ms; // zero if the GPU can't do timestamps
+};
+
+// Meshes are placed in large blocks of device memory instead of having an
+// allocation each. fragmentation is one minus the largest free range over
+// all free bytes, zero when the free space is in one piece.
+struct RendererMemoryStats
+{
+    u32 blocks; // Vulkan memory allocations
+    u32 allocations; // suballocations in the blocks
+    u64 block_bytes;
+    u64 used_bytes;
+    u32 free_ranges;
+    u64 largest_free_range;
+    f32 fragmentation;
+};
+
 void renderer_init(WindowType window_type, const GenericWindowInfo& window_data);
 void renderer_shutdown();
 RenderWorld* renderer_create_world();
@@ -33,6 +58,8 @@ void renderer_begin_frame(u32 pipeline_idx);
 void renderer_draw_world(u32 pipeline_idx, RenderWorld* w, const Vec3& cam_pos, const Quat& cam_rot);
 void renderer_draw(u32 pipeline_idx, u32 mesh_idx, const Mat4& model, const Vec3& cam_pos, const Quat& cam_rot);
 void renderer_present();
+const RendererFrameTimings& renderer_get_frame_timings();
+RendererMemoryStats renderer_get_memory_stats();
 void renderer_update_constant_buffer(u32 pipeline_idx, u32 binding, void* data, u32 data_size);
 void renderer_surface_resized(u32 w, u32 h);
 void renderer_debug_draw(const Vec3* vertices, u32 vertices_num, const Vec4* colors, PrimitiveTopology topology, const Vec3& cam_pos, const Quat& cam_rot);
\ No newline at end of file
@@ -11,6 +11,8 @@ fwd_struct(SimpleVertex);
 fwd_struct(RenderBackendMesh);
 fwd_struct(RenderBackendPipeline);
 fwd_struct(RenderBackendShader);
+fwd_struct(RendererFrameTimings);
+fwd_struct(RendererMemoryStats);
 
 void renderer_backend_init(WindowType window_type, const GenericWindowInfo& window_info);
 void renderer_backend_shutdown();
@@ -22,7 +24,7 @@ RenderBackendPipeline* renderer_backend_create_pipeline(
     const ShaderDataType* vertex_input_types, u32 vertex_input_types_num,
     const u32* constant_buffer_sizes, const u32* constant_buffer_binding_indices, u32 constant_buffers_num,
     const u32* push_constant_sizes, const ShaderType* push_constant_shader_types, u32 push_contants_num,
-    PrimitiveTopology pt, bool depth_test);
+    PrimitiveTopology pt, bool depth_test, bool instanced);
 
 RenderBackendMesh* renderer_backend_create_mesh(Mesh* mesh);
 
@@ -31,10 +33,13 @@ void renderer_backend_destroy_pipeline(RenderBackendPipeline* p);
 void renderer_backend_destroy_mesh(RenderBackendMesh* g);
 
 void renderer_backend_begin_frame(RenderBackendPipeline* pipeline);
-void renderer_backend_draw(RenderBackendPipeline* pipeline, RenderBackendMesh* mesh, const Mat4& mvp, const Mat4& model);
+// Draws instances_num instances of mesh with an instanced pipeline, one per model matrix.
+void renderer_backend_draw(RenderBackendPipeline* pipeline, RenderBackendMesh* mesh, const Mat4* models, u32 instances_num, const Mat4& view_projection);
 void renderer_backend_present();
+const RendererFrameTimings& renderer_backend_get_frame_timings();
+RendererMemoryStats renderer_backend_get_memory_stats();
 
-void renderer_backend_update_constant_buffer(const RenderBackendPipeline& pipeline, u32 binding, const void* data, u32 data_size, u32 offset);
+void renderer_backend_update_constant_buffer(RenderBackendPipeline* pipeline, u32 binding, const void* data, u32 data_size, u32 offset);
 void renderer_backend_wait_until_idle();
 void renderer_backend_surface_resized(u32 width, u32 height);
 Vec2u renderer_backend_get_size();
@@ -3,6 +3,7 @@
 #include "memory.h"
 #include "log.h"
 #include <string.h>
+#include <time.h>
 #include "mesh.h"
 #include "str.h"
 #include "render_resource.h"
@@ -13,12 +14,16 @@
 #define VERIFY_RES() check(res == VK_SUCCESS, "Vulkan error (VkResult is %s)", res)
 
 #define MAX_FRAMES_IN_FLIGHT 2
+#define TRANSIENT_BUFFER_FRAME_SIZE (8 * 1024 * 1024)
+#define MAX_CONSTANT_BUFFERS 8
+#define GPU_MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
 
 struct SwapchainBuffer
 {
     VkImage image;
     VkImageView view;
     VkFramebuffer framebuffer;
+    VkFence in_flight_fence; // fence of the frame that last drew to this image
 };
 
 struct DepthBuffer
@@ -34,31 +39,83 @@ struct RenderBackendShader
     VkShaderModule module;
 };
 
+// Updates go to data and are copied into the transient buffer before the
+// next draw with the pipeline, so each draw sees the values set before it.
 struct PipelineConstantBuffer
 {
-    VkBuffer vk_handle[MAX_FRAMES_IN_FLIGHT];
-    VkDeviceMemory memory[MAX_FRAMES_IN_FLIGHT];
+    u8* data;
     u32 binding;
     u32 size;
-    u32 allocated_size;
+    u32 transient_offset; // dynamic offset of the latest copy
 };
 
 struct RenderBackendPipeline
 {
     PipelineConstantBuffer* constant_buffers;
-    VkDescriptorSet* constant_buffer_descriptor_sets[MAX_FRAMES_IN_FLIGHT];
+    VkDescriptorSet constant_buffer_descriptor_sets[MAX_FRAMES_IN_FLIGHT];
     VkDescriptorSetLayout constant_buffer_descriptor_set_layout;
     u32 constant_buffers_num;
+    bool constant_buffers_dirty;
+    u64 constant_buffers_frame; // frame_number the copies in the transient buffer are from
     VkPipeline vk_handle;
     VkPipelineLayout layout;
 };
 
+struct TransientAllocation
+{
+    VkBuffer buffer;
+    u32 offset;
+    void* data;
+};
+
+struct GpuMemoryRange
+{
+    u64 offset;
+    u64 size;
+};
+
+// One vkAllocateMemory that buffers are placed in at offsets.
+struct GpuMemoryBlock
+{
+    VkDeviceMemory memory;
+    u8* mapped; // NULL unless the memory type is host visible
+    u64 size;
+    u64 used;
+    u32 allocations_num;
+    GpuMemoryRange* free_ranges; // dynamic, sorted by offset, neighbours are merged
+};
+
+struct GpuMemoryPool
+{
+    GpuMemoryBlock* blocks; // dynamic
+};
+
+struct GpuMemoryAllocation
+{
+    VkDeviceMemory memory;
+    u64 offset;
+    u8* mapped; // NULL unless the memory type is host visible
+    u32 memory_type_idx;
+    u32 block_idx;
+    GpuMemoryRange range; // what goes back to the block when freed, includes alignment padding
+};
+
+// Mesh data waiting in a host visible staging buffer to be copied into
+// the device local buffer the mesh draws from.
+struct MeshUpload
+{
+    VkBuffer staging_buffer;
+    GpuMemoryAllocation staging_memory;
+    VkBuffer dst_buffer;
+    u64 size;
+};
+
 struct RenderBackendMesh
 {
     VkBuffer vertex_buffer;
     VkBuffer index_buffer;
-    VkDeviceMemory vertex_buffer_memory;
-    VkDeviceMemory index_buffer_memory;
+    GpuMemoryAllocation vertex_buffer_memory;
+    GpuMemoryAllocation index_buffer_memory;
     u32 indices_num;
 };
 
@@ -84,6 +141,8 @@ struct RendererBackend
     VkQueue graphics_queue;
     u32 present_queue_family_idx;
     VkQueue present_queue;
+    u32 transfer_queue_family_idx; // same as graphics if the GPU has no transfer only family
+    VkQueue transfer_queue;
     VkCommandPool graphics_cmd_pools[MAX_FRAMES_IN_FLIGHT];
     VkCommandBuffer* command_buffers[MAX_FRAMES_IN_FLIGHT]; // MAX_FRAMES_IN_FLIGHT dynamic lists
     u32 command_buffers_recycled[MAX_FRAMES_IN_FLIGHT]; // for picking command buffesrs out of command_buffer[current_frame_idx]. Set to zero when new frame starts.
@@ -92,13 +151,45 @@ struct RendererBackend
     DepthBuffer depth_buffer;
     VkDescriptorPool descriptor_pool_uniform_buffer;
     VkRenderPass draw_render_pass;
-    VkBuffer* debug_vertex_buffers[MAX_FRAMES_IN_FLIGHT];
-    VkDeviceMemory* debug_vertex_buffers_memory[MAX_FRAMES_IN_FLIGHT];
+    VkRenderPass draw_render_pass_clear;
+    VkQueryPool timestamp_query_pool; // two per frame in flight, NULL if the GPU can't do timestamps
+    bool timestamps_written[MAX_FRAMES_IN_FLIGHT];
+    u64 frame_begin_ns;
+    u64 frame_cpu_begin_ns;
+    RendererFrameTimings frame_timings;
+    u64 frame_number;
+
+    // Ring of MAX_FRAMES_IN_FLIGHT regions of TRANSIENT_BUFFER_FRAME_SIZE,
+    // mapped for as long as it lives. Each frame allocates linearly from its
+    // region, which is reused once the frame's fence has signaled.
+    VkBuffer transient_buffer;
+    VkDeviceMemory transient_buffer_memory;
+    u8* transient_buffer_mapped;
+    u32 transient_buffer_used; // in the region of current_frame
+    GpuMemoryPool memory_pools[VK_MAX_MEMORY_TYPES]; // one per memory type
+    u32 memory_blocks_num;
+
+    // Mesh uploads are queued by create_mesh and copied in one transfer
+    // submission per frame, which the frame's graphics submission waits on.
+    // Staging buffers are freed once the upload fence of that frame has signaled.
+    MeshUpload* pending_uploads; // dynamic list, not yet submitted
+    MeshUpload* submitted_uploads[MAX_FRAMES_IN_FLIGHT]; // MAX_FRAMES_IN_FLIGHT dynamic lists
+    VkCommandPool transfer_cmd_pools[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer transfer_cmds[MAX_FRAMES_IN_FLIGHT];
+    VkSemaphore upload_finished_semaphores[MAX_FRAMES_IN_FLIGHT];
+    VkFence upload_fences[MAX_FRAMES_IN_FLIGHT];
 };
 
 static RendererBackend rbs = {};
 static bool inited = false;
 
+static u64 get_time_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL vulkan_debug_message_callback(
     VkDebugUtilsMessageSeverityFlagBitsEXT severity,
     VkDebugUtilsMessageTypeFlagsEXT type,
@@ -268,6 +359,154 @@ static u32 memory_type_from_properties(u32 req_memory_type, VkPhysicalDeviceMemo
     return -1;
 }
 
+static u64 align_up(u64 v, u64 alignment)
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+static u32 gpu_memory_create_block(u32 memory_type_idx, u64 size)
+{
+    let pool = rbs.memory_pools + memory_type_idx;
+    check(rbs.memory_blocks_num < rbs.gpu_properties.limits.maxMemoryAllocationCount, "Out of Vulkan memory allocations");
+
+    VkMemoryAllocateInfo mai = {};
+    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mai.allocationSize = size;
+    mai.memoryTypeIndex = memory_type_idx;
+
+    GpuMemoryBlock b = {
+        .size = size
+    };
+
+    VkResult res = vkAllocateMemory(rbs.device, &mai, NULL, &b.memory);
+    VERIFY_RES();
+
+    if (rbs.gpu_memory_properties.memoryTypes[memory_type_idx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        res = vkMapMemory(rbs.device, b.memory, 0, size, 0, (void**)&b.mapped);
+        VERIFY_RES();
+    }
+
+    da_push(b.free_ranges, (GpuMemoryRange{ .offset = 0, .size = size }));
+    da_push(pool->blocks, b);
+    ++rbs.memory_blocks_num;
+    return da_num(pool->blocks) - 1;
+}
+
+// First fit over the free ranges of the blocks with the right memory type,
+// a new block is only made when none of them has room.
+static GpuMemoryAllocation gpu_memory_alloc(const VkMemoryRequirements& mr, VkMemoryPropertyFlags properties)
+{
+    let memory_type_idx = memory_type_from_properties(mr.memoryTypeBits, &rbs.gpu_memory_properties, properties);
+    check(memory_type_idx != (u32)-1, "Couldn't find memory of correct type.");
+    let pool = rbs.memory_pools + memory_type_idx;
+
+    for (u32 pass = 0; pass < 2; ++pass)
+    {
+        if (pass == 1)
+            gpu_memory_create_block(memory_type_idx, mr.size > GPU_MEMORY_BLOCK_SIZE ? mr.size : GPU_MEMORY_BLOCK_SIZE);
+
+        // Newest block first, it is the only one to check on the second pass.
+        for (u32 block_idx = da_num(pool->blocks); block_idx-- > 0;)
+        {
+            let b = pool->blocks + block_idx;
+
+            for (u32 range_idx = 0; range_idx < da_num(b->free_ranges); ++range_idx)
+            {
+                let r = b->free_ranges + range_idx;
+                let offset = align_up(r->offset, mr.alignment);
+
+                if (offset + mr.size > r->offset + r->size)
+                    continue;
+
+                // The alignment padding goes with the allocation so freeing gives back exactly this range.
+                GpuMemoryAllocation a = {
+                    .memory = b->memory,
+                    .offset = offset,
+                    .mapped = b->mapped ? b->mapped + offset : NULL,
+                    .memory_type_idx = memory_type_idx,
+                    .block_idx = block_idx,
+                    .range = { .offset = r->offset, .size = offset + mr.size - r->offset }
+                };
+
+                r->offset += a.range.size;
+                r->size -= a.range.size;
+
+                if (r->size == 0)
+                {
+                    for (u32 i = range_idx; i + 1 < da_num(b->free_ranges); ++i)
+                        b->free_ranges[i] = b->free_ranges[i + 1];
+
+                    (void)da_pop(b->free_ranges);
+                }
+
+                b->used += a.range.size;
+                ++b->allocations_num;
+                return a;
+            }
+
+            if (pass == 1)
+                break;
+        }
+    }
+
+    error("Failed allocating %llu bytes of GPU memory", (unsigned long long)mr.size);
+}
+
+// Puts the range back in offset order and merges it with free neighbours.
+static void gpu_memory_free(const GpuMemoryAllocation& a)
+{
+    let b = rbs.memory_pools[a.memory_type_idx].blocks + a.block_idx;
+    u32 idx = 0;
+
+    while (idx < da_num(b->free_ranges) && b->free_ranges[idx].offset < a.range.offset)
+        ++idx;
+
+    da_insert(b->free_ranges, a.range, idx);
+
+    if (idx + 1 < da_num(b->free_ranges) && b->free_ranges[idx].offset + b->free_ranges[idx].size == b->free_ranges[idx + 1].offset)
+    {
+        b->free_ranges[idx].size += b->free_ranges[idx + 1].size;
+
+        for (u32 i = idx + 1; i + 1 < da_num(b->free_ranges); ++i)
+            b->free_ranges[i] = b->free_ranges[i + 1];
+
+        (void)da_pop(b->free_ranges);
+    }
+
+    if (idx > 0 && b->free_ranges[idx - 1].offset + b->free_ranges[idx - 1].size == b->free_ranges[idx].offset)
+    {
+        b->free_ranges[idx - 1].size += b->free_ranges[idx].size;
+
+        for (u32 i = idx; i + 1 < da_num(b->free_ranges); ++i)
+            b->free_ranges[i] = b->free_ranges[i + 1];
+
+        (void)da_pop(b->free_ranges);
+    }
+
+    b->used -= a.range.size;
+    --b->allocations_num;
+}
+
+static void gpu_memory_destroy_pools()
+{
+    for (u32 type_idx = 0; type_idx < VK_MAX_MEMORY_TYPES; ++type_idx)
+    {
+        let pool = rbs.memory_pools + type_idx;
+
+        da_foreach(b, pool->blocks)
+        {
+            check(b->allocations_num == 0, "GPU memory block destroyed while still in use");
+            vkFreeMemory(rbs.device, b->memory, NULL);
+            da_free(b->free_ranges);
+        }
+
+        da_free(pool->blocks);
+    }
+
+    rbs.memory_blocks_num = 0;
+}
+
 static void destroy_depth_buffer(VkDevice device, DepthBuffer* depth_buffer)
 {
     info("Destroying depth buffer");
@@ -304,7 +543,7 @@ static void create_depth_buffer(DepthBuffer* out_depth_buffer, VkDevice device,
 
     depth_ici.samples = NUM_SAMPLES;
     depth_ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depth_ici.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    depth_ici.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     depth_ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VkResult res;
@@ -365,10 +604,80 @@ static void destroy_surface_size_dependent_resources()
 
     vkDestroyRenderPass(rbs.device, rbs.draw_render_pass, NULL);
     rbs.draw_render_pass = NULL;
+    vkDestroyRenderPass(rbs.device, rbs.draw_render_pass_clear, NULL);
+    rbs.draw_render_pass_clear = NULL;
 
     destroy_depth_buffer(rbs.device, &rbs.depth_buffer);
 }
 
+// Both passes are compatible, so pipelines and framebuffers made with one work
+// with the other. The clearing one starts each frame, the loading one lets
+// debug drawing add to what is already there.
+static VkRenderPass create_draw_render_pass(VkAttachmentLoadOp load_op)
+{
+    bool clear = load_op == VK_ATTACHMENT_LOAD_OP_CLEAR;
+    VkAttachmentDescription attachments[2];
+    memzero(attachments, sizeof(VkAttachmentDescription) * 2);
+    attachments[0].format = rbs.surface_format;
+    attachments[0].samples = NUM_SAMPLES;
+    attachments[0].loadOp = load_op;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    attachments[1].format = rbs.depth_buffer.format;
+    attachments[1].samples = NUM_SAMPLES;
+    attachments[1].loadOp = load_op;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference color_reference = {};
+    color_reference.attachment = 0;
+    color_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depth_reference = {};
+    depth_reference.attachment = 1;
+    depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_reference;
+    subpass.pDepthStencilAttachment = &depth_reference;
+
+    // Frames in flight share the depth buffer and the swapchain image is only
+    // ready once the acquire semaphore wait at color output has passed, so
+    // attachment access has to wait for both.
+    VkSubpassDependency dependency = {
+        .srcSubpass = VK_SUBPASS_EXTERNAL,
+        .dstSubpass = 0,
+        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+    };
+
+    VkRenderPassCreateInfo rpci = {};
+    rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    rpci.attachmentCount = 2;
+    rpci.pAttachments = attachments;
+    rpci.subpassCount = 1;
+    rpci.pSubpasses = &subpass;
+    rpci.dependencyCount = 1;
+    rpci.pDependencies = &dependency;
+
+    VkRenderPass rp;
+    VkResult res = vkCreateRenderPass(rbs.device, &rpci, NULL, &rp);
+    VERIFY_RES();
+    return rp;
+}
+
 static void create_surface_size_dependent_resources()
 {
     VkSurfaceCapabilitiesKHR surface_capabilities;
@@ -380,52 +689,9 @@ static void create_surface_size_dependent_resources()
     
     create_depth_buffer(&rbs.depth_buffer, rbs.device, rbs.gpu, &rbs.gpu_memory_properties, rbs.swapchain_size);
 
-    {
-        info("Creating draw render pass");
-        VkAttachmentDescription attachments[2];
-        memzero(attachments, sizeof(VkAttachmentDescription) * 2);
-        attachments[0].format = rbs.surface_format;
-        attachments[0].samples = NUM_SAMPLES;
-        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-        attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        attachments[1].format = rbs.depth_buffer.format;
-        attachments[1].samples = NUM_SAMPLES;
-        attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-        attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentReference color_reference = {};
-        color_reference.attachment = 0;
-        color_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentReference depth_reference = {};
-        depth_reference.attachment = 1;
-        depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass = {};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &color_reference;
-        subpass.pDepthStencilAttachment = &depth_reference;
-
-        VkRenderPassCreateInfo rpci = {};
-        rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        rpci.attachmentCount = 2;
-        rpci.pAttachments = attachments;
-        rpci.subpassCount = 1;
-        rpci.pSubpasses = &subpass;
-
-        res = vkCreateRenderPass(rbs.device, &rpci, NULL, &rbs.draw_render_pass);
-        VERIFY_RES();
-    }
+    info("Creating draw render passes");
+    rbs.draw_render_pass = create_draw_render_pass(VK_ATTACHMENT_LOAD_OP_LOAD);
+    rbs.draw_render_pass_clear = create_draw_render_pass(VK_ATTACHMENT_LOAD_OP_CLEAR);
 
     create_swapchain(
         &rbs.swapchain, &rbs.swapchain_buffers, &rbs.swapchain_buffers_num, rbs.swapchain_size,
@@ -649,22 +915,44 @@ void renderer_backend_init(WindowType window_type, const GenericWindowInfo& wind
         }
     }
     check(rbs.present_queue_family_idx != (u32)-1, "Couldn't find present queue family");
+
+    // A transfer only family usually maps to the GPU's copy engines, which run
+    // uploads alongside rendering. Graphics families can always transfer too.
+    rbs.transfer_queue_family_idx = rbs.graphics_queue_family_idx;
+    for (u32 i = 0; i < queue_family_count; ++i)
+    {
+        let flags = queue_family_props[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            rbs.transfer_queue_family_idx = i;
+            info("Found transfer only queue family");
+            break;
+        }
+    }
     memf(queues_with_present_support);
     memf(queue_family_props);
 
     info("Creating Vulkan logical device");
-    VkDeviceQueueCreateInfo dqci = {};
-    dqci.queueFamilyIndex = rbs.graphics_queue_family_idx;
-    dqci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    dqci.queueCount = 1;
     f32 queue_priorities[] = {0.0};
-    dqci.pQueuePriorities = queue_priorities;
+    VkDeviceQueueCreateInfo dqcis[2] = {};
+    u32 dqcis_num = 1;
+    dqcis[0].queueFamilyIndex = rbs.graphics_queue_family_idx;
+    dqcis[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    dqcis[0].queueCount = 1;
+    dqcis[0].pQueuePriorities = queue_priorities;
+
+    if (rbs.transfer_queue_family_idx != rbs.graphics_queue_family_idx)
+    {
+        dqcis[1] = dqcis[0];
+        dqcis[1].queueFamilyIndex = rbs.transfer_queue_family_idx;
+        ++dqcis_num;
+    }
 
     char* device_extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     VkDeviceCreateInfo dci = {};
     dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    dci.queueCreateInfoCount = 1;
-    dci.pQueueCreateInfos = &dqci;
+    dci.queueCreateInfoCount = dqcis_num;
+    dci.pQueueCreateInfos = dqcis;
     dci.ppEnabledExtensionNames = device_extensions;
     dci.enabledExtensionCount = sizeof(device_extensions)/sizeof(char*);
 
@@ -684,9 +972,11 @@ void renderer_backend_init(WindowType window_type, const GenericWindowInfo& wind
     else
         vkGetDeviceQueue(device, rbs.present_queue_family_idx, 0, &rbs.present_queue);
 
+    vkGetDeviceQueue(device, rbs.transfer_queue_family_idx, 0, &rbs.transfer_queue);
+
     info("Creating descriptor pools");
     VkDescriptorPoolSize dps[1];
-    dps[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    dps[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     dps[0].descriptorCount = 10;
 
     VkDescriptorPoolCreateInfo dpci = {};
@@ -699,6 +989,35 @@ void renderer_backend_init(WindowType window_type, const GenericWindowInfo& wind
     res = vkCreateDescriptorPool(device, &dpci, NULL, &rbs.descriptor_pool_uniform_buffer);
     VERIFY_RES();
 
+    info("Creating transient buffer");
+    {
+        VkBufferCreateInfo bci = {};
+        bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bci.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        bci.size = TRANSIENT_BUFFER_FRAME_SIZE * MAX_FRAMES_IN_FLIGHT;
+        bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        res = vkCreateBuffer(device, &bci, NULL, &rbs.transient_buffer);
+        VERIFY_RES();
+
+        VkMemoryRequirements mr;
+        vkGetBufferMemoryRequirements(device, rbs.transient_buffer, &mr);
+        VkMemoryAllocateInfo mai = {};
+        mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        mai.allocationSize = mr.size;
+        mai.memoryTypeIndex = memory_type_from_properties(mr.memoryTypeBits, &rbs.gpu_memory_properties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        check(mai.memoryTypeIndex != (u32)-1, "Couldn't find memory of correct type.");
+
+        res = vkAllocateMemory(device, &mai, NULL, &rbs.transient_buffer_memory);
+        VERIFY_RES();
+        res = vkBindBufferMemory(device, rbs.transient_buffer, rbs.transient_buffer_memory, 0);
+        VERIFY_RES();
+
+        // Never unmapped, freeing the memory at shutdown does that.
+        res = vkMapMemory(device, rbs.transient_buffer_memory, 0, mr.size, 0, (void**)&rbs.transient_buffer_mapped);
+        VERIFY_RES();
+    }
+
     info("Creating command pools, semaphores and fences for frame syncronisation.");
 
     VkSemaphoreCreateInfo iasci = {};
@@ -713,10 +1032,29 @@ void renderer_backend_init(WindowType window_type, const GenericWindowInfo& wind
     cpci.queueFamilyIndex = rbs.graphics_queue_family_idx;
     cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
+    VkCommandPoolCreateInfo tcpci = {};
+    tcpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    tcpci.queueFamilyIndex = rbs.transfer_queue_family_idx;
+    tcpci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
     for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         res = vkCreateCommandPool(device, &cpci, NULL, &rbs.graphics_cmd_pools[i]);
         VERIFY_RES();
+        res = vkCreateCommandPool(device, &tcpci, NULL, &rbs.transfer_cmd_pools[i]);
+        VERIFY_RES();
+
+        VkCommandBufferAllocateInfo cbai = {};
+        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbai.commandPool = rbs.transfer_cmd_pools[i];
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbai.commandBufferCount = 1;
+        res = vkAllocateCommandBuffers(device, &cbai, &rbs.transfer_cmds[i]);
+        VERIFY_RES();
+        res = vkCreateSemaphore(device, &iasci, NULL, &rbs.upload_finished_semaphores[i]);
+        VERIFY_RES();
+        res = vkCreateFence(device, &fci, NULL, &rbs.upload_fences[i]);
+        VERIFY_RES();
         res = vkCreateSemaphore(device, &iasci, NULL, &rbs.image_available_semaphores[i]);
         VERIFY_RES();
         res = vkCreateSemaphore(device, &iasci, NULL, &rbs.render_finished_semaphores[i]);
@@ -724,6 +1062,18 @@ void renderer_backend_init(WindowType window_type, const GenericWindowInfo& wind
         res = vkCreateFence(device, &fci, NULL, &rbs.image_in_flight_fences[i]);
         VERIFY_RES();
     }
+
+    if (rbs.gpu_properties.limits.timestampComputeAndGraphics)
+    {
+        VkQueryPoolCreateInfo qpci = {};
+        qpci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        qpci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        qpci.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+        res = vkCreateQueryPool(device, &qpci, NULL, &rbs.timestamp_query_pool);
+        VERIFY_RES();
+    }
+    else
+        info("GPU doesn't support timestamps, GPU frame time will read zero");
 }
 
 void renderer_backend_destroy_shader(RenderBackendShader* s)
@@ -737,16 +1087,12 @@ void renderer_backend_destroy_pipeline(RenderBackendPipeline* p)
     for (u32 frame_idx = 0; frame_idx < MAX_FRAMES_IN_FLIGHT; ++frame_idx)
     {
         if (p->constant_buffer_descriptor_sets[frame_idx])
-            vkFreeDescriptorSets(rbs.device, rbs.descriptor_pool_uniform_buffer, 1, p->constant_buffer_descriptor_sets[frame_idx]);
-
-        memf(p->constant_buffer_descriptor_sets[frame_idx]);
-        for (u32 cb_idx = 0; cb_idx < p->constant_buffers_num; ++cb_idx)
-        {
-            vkDestroyBuffer(rbs.device, p->constant_buffers[cb_idx].vk_handle[frame_idx], NULL);
-            vkFreeMemory(rbs.device, p->constant_buffers[cb_idx].memory[frame_idx], NULL);
-        }
+            vkFreeDescriptorSets(rbs.device, rbs.descriptor_pool_uniform_buffer, 1, &p->constant_buffer_descriptor_sets[frame_idx]);
     }
 
+    for (u32 cb_idx = 0; cb_idx < p->constant_buffers_num; ++cb_idx)
+        memf(p->constant_buffers[cb_idx].data);
+
     vkDestroyPipelineLayout(rbs.device, p->layout, NULL);
     vkDestroyDescriptorSetLayout(rbs.device, p->constant_buffer_descriptor_set_layout, NULL);
     vkDestroyPipeline(rbs.device, p->vk_handle, NULL);
@@ -754,16 +1100,56 @@ void renderer_backend_destroy_pipeline(RenderBackendPipeline* p)
     memf(p);
 }
 
+static void free_mesh_upload(const MeshUpload& u)
+{
+    vkDestroyBuffer(rbs.device, u.staging_buffer, NULL);
+    gpu_memory_free(u.staging_memory);
+}
+
+static void free_submitted_uploads(u32 frame_idx)
+{
+    da_foreach(u, rbs.submitted_uploads[frame_idx])
+        free_mesh_upload(*u);
+
+    da_clear(rbs.submitted_uploads[frame_idx]);
+}
+
 void renderer_backend_destroy_mesh(RenderBackendMesh* g)
 {
+    // Uploads that haven't been submitted are dropped, submitted ones have to finish first.
+    for (u32 i = 0; i < da_num(rbs.pending_uploads);)
+    {
+        let u = rbs.pending_uploads[i];
+
+        if (u.dst_buffer == g->vertex_buffer || u.dst_buffer == g->index_buffer)
+        {
+            free_mesh_upload(u);
+            rbs.pending_uploads[i] = da_last(rbs.pending_uploads);
+            (void)da_pop(rbs.pending_uploads);
+        }
+        else
+            ++i;
+    }
+
+    for (u32 frame_idx = 0; frame_idx < MAX_FRAMES_IN_FLIGHT; ++frame_idx)
+    {
+        da_foreach(u, rbs.submitted_uploads[frame_idx])
+        {
+            if (u->dst_buffer == g->vertex_buffer || u->dst_buffer == g->index_buffer)
+            {
+                vkWaitForFences(rbs.device, 1, &rbs.upload_fences[frame_idx], VK_TRUE, UINT64_MAX);
+                break;
+            }
+        }
+    }
+
     vkDestroyBuffer(rbs.device, g->vertex_buffer, NULL);
-    vkFreeMemory(rbs.device, g->vertex_buffer_memory, NULL);
+    gpu_memory_free(g->vertex_buffer_memory);
     vkDestroyBuffer(rbs.device, g->index_buffer, NULL);
-    vkFreeMemory(rbs.device, g->index_buffer_memory, NULL);
+    gpu_memory_free(g->index_buffer_memory);
     memf(g);
 }
 
-static void destroy_debug_vertex_buffers(u32 frame_idx);
 
 void renderer_backend_shutdown()
 {
@@ -774,8 +1160,16 @@ void renderer_backend_shutdown()
     for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         vkWaitForFences(d, 1, &rbs.image_in_flight_fences[i], VK_TRUE, UINT64_MAX);
+        vkWaitForFences(d, 1, &rbs.upload_fences[i], VK_TRUE, UINT64_MAX);
+        free_submitted_uploads(i);
+        da_free(rbs.submitted_uploads[i]);
     }
 
+    da_foreach(u, rbs.pending_uploads)
+        free_mesh_upload(*u);
+
+    da_free(rbs.pending_uploads);
+
     for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(d, rbs.render_finished_semaphores[i], NULL);
         vkDestroySemaphore(d, rbs.image_available_semaphores[i], NULL);
@@ -785,9 +1179,20 @@ void renderer_backend_shutdown()
         da_free(rbs.command_buffers[i]);
         vkDestroyCommandPool(d, rbs.graphics_cmd_pools[i], NULL);
 
-        destroy_debug_vertex_buffers(i);
+        vkDestroySemaphore(d, rbs.upload_finished_semaphores[i], NULL);
+        vkDestroyFence(d, rbs.upload_fences[i], NULL);
+        vkFreeCommandBuffers(d, rbs.transfer_cmd_pools[i], 1, &rbs.transfer_cmds[i]);
+        vkDestroyCommandPool(d, rbs.transfer_cmd_pools[i], NULL);
+
     }
 
+    vkDestroyBuffer(d, rbs.transient_buffer, NULL);
+    vkFreeMemory(d, rbs.transient_buffer_memory, NULL);
+    gpu_memory_destroy_pools();
+
+    if (rbs.timestamp_query_pool)
+        vkDestroyQueryPool(d, rbs.timestamp_query_pool, NULL);
+
     destroy_surface_size_dependent_resources();
     vkDestroyDescriptorPool(d, rbs.descriptor_pool_uniform_buffer, NULL);
 
@@ -855,13 +1260,15 @@ RenderBackendPipeline* renderer_backend_create_pipeline(
     const ShaderDataType* vertex_input_types, u32 vertex_input_types_num,
     const u32* constant_buffer_sizes, const u32* constant_buffer_binding_indices, u32 constant_buffers_num,
     const u32* push_constants_sizes, const ShaderType* push_constants_shader_types, u32 push_constants_num,
-    PrimitiveTopology pt, bool depth_test)
+    PrimitiveTopology pt, bool depth_test, bool instanced)
 {
     RenderBackendPipeline* pipeline = mema_zero_t(RenderBackendPipeline);
     VkResult res;
 
     // Create vk descriptors that describe the input to vertex shader and the stride of the vertex data.
-    VkVertexInputAttributeDescription* viad = mema_zero_tn(VkVertexInputAttributeDescription, vertex_input_types_num);
+    u32 instance_attributes_num = instanced ? 4 : 0;
+    u32 attributes_num = vertex_input_types_num + instance_attributes_num;
+    VkVertexInputAttributeDescription* viad = mema_zero_tn(VkVertexInputAttributeDescription, attributes_num);
 
     u32 layout_offset = 0;
     for (u32 i = 0; i < vertex_input_types_num; ++i)
@@ -875,21 +1282,37 @@ RenderBackendPipeline* renderer_backend_create_pipeline(
 
     u32 stride = layout_offset;
 
-    VkVertexInputBindingDescription vibd = {};
-    vibd.binding = 0;
-    vibd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-    vibd.stride = stride;
+    // Instanced pipelines get the model matrix from binding 1, one vec4 column per location after the vertex input.
+    for (u32 i = 0; i < instance_attributes_num; ++i)
+    {
+        let a = viad + vertex_input_types_num + i;
+        a->binding = 1;
+        a->location = vertex_input_types_num + i;
+        a->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        a->offset = i * sizeof(Vec4);
+    }
+
+    VkVertexInputBindingDescription vibd[2] = {};
+    vibd[0].binding = 0;
+    vibd[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    vibd[0].stride = stride;
+    vibd[1].binding = 1;
+    vibd[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    vibd[1].stride = sizeof(Mat4);
 
     VkPipelineVertexInputStateCreateInfo pvisci = {};
     pvisci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    pvisci.vertexBindingDescriptionCount = 1;
-    pvisci.pVertexBindingDescriptions = &vibd;
-    pvisci.vertexAttributeDescriptionCount = vertex_input_types_num;
+    pvisci.vertexBindingDescriptionCount = instanced ? 2 : 1;
+    pvisci.pVertexBindingDescriptions = vibd;
+    pvisci.vertexAttributeDescriptionCount = attributes_num;
     pvisci.pVertexAttributeDescriptions = viad;
 
-    // Create vk uniform buffers for our constant buffers
+    // Constant buffers live in the transient buffer, the descriptors point at
+    // it and the offset into it is given when binding.
+    check(constant_buffers_num <= MAX_CONSTANT_BUFFERS, "Pipeline has more than MAX_CONSTANT_BUFFERS constant buffers");
     pipeline->constant_buffers = mema_zero_tn(PipelineConstantBuffer, constant_buffers_num);
     pipeline->constant_buffers_num = constant_buffers_num;
+    pipeline->constant_buffers_dirty = true;
     VkDescriptorSetLayoutBinding* constant_buffer_bindings = mema_zero_tn(VkDescriptorSetLayoutBinding, constant_buffers_num);
 
     for (u32 cb_idx = 0; cb_idx < constant_buffers_num; ++cb_idx)
@@ -897,37 +1320,10 @@ RenderBackendPipeline* renderer_backend_create_pipeline(
         PipelineConstantBuffer* cb = pipeline->constant_buffers + cb_idx;
         cb->binding = constant_buffer_binding_indices[cb_idx];
         cb->size = constant_buffer_sizes[cb_idx];
-
-        VkBufferCreateInfo cb_bci = {};
-        cb_bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        cb_bci.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        cb_bci.size = cb->size;
-        cb_bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-        {
-            res = vkCreateBuffer(rbs.device, &cb_bci, NULL, &cb->vk_handle[i]);
-            VERIFY_RES();
-        
-            VkMemoryRequirements uniform_buffer_mem_reqs;
-            vkGetBufferMemoryRequirements(rbs.device, cb->vk_handle[i], &uniform_buffer_mem_reqs);
-
-            VkMemoryAllocateInfo uniform_buffer_mai = {};
-            uniform_buffer_mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            uniform_buffer_mai.allocationSize = uniform_buffer_mem_reqs.size;
-            cb->allocated_size = uniform_buffer_mem_reqs.size;
-
-            uniform_buffer_mai.memoryTypeIndex = memory_type_from_properties(uniform_buffer_mem_reqs.memoryTypeBits, &rbs.gpu_memory_properties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-            check(uniform_buffer_mai.memoryTypeIndex != (u32)-1, "Failed finding memory type for uniform buffer");
-
-            res = vkAllocateMemory(rbs.device, &uniform_buffer_mai, NULL, &cb->memory[i]);
-            VERIFY_RES();
-            res = vkBindBufferMemory(rbs.device, cb->vk_handle[i], cb->memory[i], 0);
-            VERIFY_RES();
-        }
+        cb->data = (u8*)mema_zero(cb->size);
 
         constant_buffer_bindings[cb_idx].binding = cb->binding;
-        constant_buffer_bindings[cb_idx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        constant_buffer_bindings[cb_idx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         constant_buffer_bindings[cb_idx].descriptorCount = 1;
         constant_buffer_bindings[cb_idx].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     }
@@ -944,18 +1340,37 @@ RenderBackendPipeline* renderer_backend_create_pipeline(
 
     if (constant_buffers_num > 0)
     {
+        VkDescriptorBufferInfo* dbis = mema_zero_tn(VkDescriptorBufferInfo, constant_buffers_num);
+        VkWriteDescriptorSet* writes = mema_zero_tn(VkWriteDescriptorSet, constant_buffers_num);
+
         for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
         {
-            pipeline->constant_buffer_descriptor_sets[i] = mema_zero_tn(VkDescriptorSet, constant_buffers_num);
             VkDescriptorSetAllocateInfo dsai = {};
             dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
             dsai.pNext = NULL;
             dsai.descriptorPool = rbs.descriptor_pool_uniform_buffer;
-            dsai.descriptorSetCount = constant_buffers_num;
+            dsai.descriptorSetCount = 1;
             dsai.pSetLayouts = &pipeline->constant_buffer_descriptor_set_layout;
-            res = vkAllocateDescriptorSets(rbs.device, &dsai, pipeline->constant_buffer_descriptor_sets[i]);
+            res = vkAllocateDescriptorSets(rbs.device, &dsai, &pipeline->constant_buffer_descriptor_sets[i]);
             VERIFY_RES();
+
+            for (u32 cb_idx = 0; cb_idx < constant_buffers_num; ++cb_idx)
+            {
+                dbis[cb_idx].buffer = rbs.transient_buffer;
+                dbis[cb_idx].range = pipeline->constant_buffers[cb_idx].size;
+                writes[cb_idx].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[cb_idx].dstSet = pipeline->constant_buffer_descriptor_sets[i];
+                writes[cb_idx].dstBinding = pipeline->constant_buffers[cb_idx].binding;
+                writes[cb_idx].descriptorCount = 1;
+                writes[cb_idx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                writes[cb_idx].pBufferInfo = dbis + cb_idx;
+            }
+
+            vkUpdateDescriptorSets(rbs.device, constant_buffers_num, writes, 0, NULL);
         }
+
+        memf(writes);
+        memf(dbis);
     }
 
     VkPushConstantRange* push_constants = mema_zero_tn(VkPushConstantRange, push_constants_num);
@@ -1111,135 +1526,75 @@ RenderBackendPipeline* renderer_backend_create_pipeline(
     return pipeline;
 }
 
-RenderBackendMesh* renderer_backend_create_mesh(Mesh* m)
+static void create_buffer(VkBufferUsageFlags usage, u64 size, VkMemoryPropertyFlags properties, VkBuffer* out_buffer, GpuMemoryAllocation* out_memory)
 {
-    VkResult res;
-
-
-    // Vertexbuffer
-    VkBuffer vertex_buffer;
-    VkDeviceMemory vertex_buffer_memory;
-
+    u32 queue_family_indices[2] = {rbs.graphics_queue_family_idx, rbs.transfer_queue_family_idx};
+    VkBufferCreateInfo bci = {};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.usage = usage;
+    bci.size = size;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Concurrent sharing saves transferring ownership from the transfer queue to the graphics one.
+    if (rbs.transfer_queue_family_idx != rbs.graphics_queue_family_idx)
     {
-        VkBufferCreateInfo vertex_bci = {};
-        vertex_bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        vertex_bci.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-        vertex_bci.size = sizeof(MeshVertex) * m->vertices_num;
-        vertex_bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    
-        res = vkCreateBuffer(rbs.device, &vertex_bci, NULL, &vertex_buffer);
-        VERIFY_RES();
-    
-        VkMemoryRequirements vertex_buffer_mr;
-        vkGetBufferMemoryRequirements(rbs.device, vertex_buffer, &vertex_buffer_mr);
-        VkMemoryAllocateInfo vertex_buffer_mai = {};
-        vertex_buffer_mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        vertex_buffer_mai.allocationSize = vertex_buffer_mr.size;
-        vertex_buffer_mai.memoryTypeIndex = memory_type_from_properties(vertex_buffer_mr.memoryTypeBits, &rbs.gpu_memory_properties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        check(vertex_buffer_mai.memoryTypeIndex != (u32)-1, "Couldn't find memory of correct type.");
-    
-        res = vkAllocateMemory(rbs.device, &vertex_buffer_mai, NULL, &vertex_buffer_memory);
-        VERIFY_RES();
-    
-        u8* vertex_buffer_memory_data;
-        res = vkMapMemory(rbs.device, vertex_buffer_memory, 0, vertex_buffer_mr.size, 0, (void**)&vertex_buffer_memory_data);
-        VERIFY_RES();
-    
-        memcpy(vertex_buffer_memory_data, m->vertices, sizeof(MeshVertex) * m->vertices_num);
-    
-        vkUnmapMemory(rbs.device, vertex_buffer_memory);
-    
-        res = vkBindBufferMemory(rbs.device, vertex_buffer, vertex_buffer_memory, 0);
-        VERIFY_RES();
+        bci.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bci.queueFamilyIndexCount = 2;
+        bci.pQueueFamilyIndices = queue_family_indices;
     }
 
+    VkResult res = vkCreateBuffer(rbs.device, &bci, NULL, out_buffer);
+    VERIFY_RES();
 
-    // Indexbuffer
+    VkMemoryRequirements mr;
+    vkGetBufferMemoryRequirements(rbs.device, *out_buffer, &mr);
+    *out_memory = gpu_memory_alloc(mr, properties);
 
-    VkBuffer index_buffer;
-    VkDeviceMemory index_buffer_memory;
-    {
-        VkBufferCreateInfo index_bci = {};
-        index_bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        index_bci.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-        index_bci.size = sizeof(MeshIndex) * m->indices_num;
-        index_bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    
-        res = vkCreateBuffer(rbs.device, &index_bci, NULL, &index_buffer);
-        VERIFY_RES();
+    res = vkBindBufferMemory(rbs.device, *out_buffer, out_memory->memory, out_memory->offset);
+    VERIFY_RES();
+}
 
-        VkMemoryRequirements index_buffer_mr;
-        vkGetBufferMemoryRequirements(rbs.device, index_buffer, &index_buffer_mr);
-        VkMemoryAllocateInfo index_buffer_mai = {};
-        index_buffer_mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        index_buffer_mai.allocationSize = index_buffer_mr.size;
-        index_buffer_mai.memoryTypeIndex = memory_type_from_properties(index_buffer_mr.memoryTypeBits, &rbs.gpu_memory_properties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        check(index_buffer_mai.memoryTypeIndex != (u32)-1, "Couldn't find memory of correct type.");
-    
-        res = vkAllocateMemory(rbs.device, &index_buffer_mai, NULL, &index_buffer_memory);
-        VERIFY_RES();
-    
-        u8* index_buffer_memory_data;
-        res = vkMapMemory(rbs.device, index_buffer_memory, 0, index_buffer_mr.size, 0, (void**)&index_buffer_memory_data);
-        VERIFY_RES();
-    
-        memcpy(index_buffer_memory_data, m->indices, sizeof(MeshIndex) * m->indices_num);
-    
-        vkUnmapMemory(rbs.device, index_buffer_memory);
-    
-        res = vkBindBufferMemory(rbs.device, index_buffer, index_buffer_memory, 0);
-        VERIFY_RES();
-    }
+// Doesn't wait for the copy, it's queued and goes with the next present.
+static void create_mesh_buffer(VkBufferUsageFlags usage, const void* data, u64 size, VkBuffer* out_buffer, GpuMemoryAllocation* out_memory)
+{
+    create_buffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, out_buffer, out_memory);
 
-    RenderBackendMesh g = {
-        .vertex_buffer = vertex_buffer,
-        .vertex_buffer_memory = vertex_buffer_memory,
-        .index_buffer = index_buffer,
-        .index_buffer_memory = index_buffer_memory,
-        .indices_num = m->indices_num
+    MeshUpload u = {
+        .dst_buffer = *out_buffer,
+        .size = size
     };
 
-    return mema_copy_t(&g, RenderBackendMesh);
+    create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &u.staging_buffer, &u.staging_memory);
+    memcpy(u.staging_memory.mapped, data, size);
+    da_push(rbs.pending_uploads, u);
 }
 
-void renderer_backend_update_constant_buffer(const RenderBackendPipeline& pipeline, u32 binding, const void* data, u32 data_size, u32 offset)
+RenderBackendMesh* renderer_backend_create_mesh(Mesh* m)
 {
-    u32 cf = rbs.current_frame;
-    VkResult res;
+    RenderBackendMesh* g = mema_zero_t(RenderBackendMesh);
+    create_mesh_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m->vertices, sizeof(MeshVertex) * m->vertices_num, &g->vertex_buffer, &g->vertex_buffer_memory);
+    create_mesh_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m->indices, sizeof(MeshIndex) * m->indices_num, &g->index_buffer, &g->index_buffer_memory);
+    g->indices_num = m->indices_num;
+    return g;
+}
 
+void renderer_backend_update_constant_buffer(RenderBackendPipeline* pipeline, u32 binding, const void* data, u32 data_size, u32 offset)
+{
     PipelineConstantBuffer* cb = NULL;
-    u32 cb_idx = -1;
 
-    for (u32 i = 0; i < pipeline.constant_buffers_num; ++i)
+    for (u32 i = 0; i < pipeline->constant_buffers_num; ++i)
     {
-        if (pipeline.constant_buffers[i].binding == binding)
+        if (pipeline->constant_buffers[i].binding == binding)
         {
-            cb = pipeline.constant_buffers + i;
-            cb_idx = i;
+            cb = pipeline->constant_buffers + i;
             break;
         }
     }
 
     check(cb, "No constant buffer with binding %d in supplied pipeline", binding);
-
-    u8* mapped_uniform_data;
-    res = vkMapMemory(rbs.device, cb->memory[cf], offset, cb->allocated_size - offset, 0, (void**)&mapped_uniform_data);
-    VERIFY_RES();
-    memcpy(mapped_uniform_data, data, data_size);
-    vkUnmapMemory(rbs.device, cb->memory[cf]);
-
-    VkDescriptorBufferInfo dbi = {};
-    dbi.buffer = cb->vk_handle[cf];
-    dbi.range = cb->size;
-
-    VkWriteDescriptorSet write = {};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = pipeline.constant_buffer_descriptor_sets[cf][cb_idx];
-    write.descriptorCount = 1;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    write.pBufferInfo = &dbi;
-
-    vkUpdateDescriptorSets(rbs.device, 1, &write, 0, NULL);
+    check(offset + data_size <= cb->size, "Constant buffer update outside of constant buffer");
+    memcpy(cb->data + offset, data, data_size);
+    pipeline->constant_buffers_dirty = true;
 }
 
 static VkIndexType get_index_type(MeshIndex gi)
@@ -1271,25 +1626,83 @@ static VkCommandBuffer get_new_command_buffer()
     return b;
 }
 
-static void destroy_debug_vertex_buffers(u32 frame_idx)
+// Valid until the fence of the current frame signals, which is after the GPU has used it.
+static TransientAllocation transient_alloc(u32 size, u32 alignment)
 {
-    check(da_num(rbs.debug_vertex_buffers[frame_idx]) == da_num(rbs.debug_vertex_buffers_memory[frame_idx]), "Mismatch between number of debug vertex buffers and their memory");
-    for (u32 i = 0; i < da_num(rbs.debug_vertex_buffers[frame_idx]); ++i)
+    u32 offset = (rbs.transient_buffer_used + alignment - 1) / alignment * alignment;
+    check(offset + size <= TRANSIENT_BUFFER_FRAME_SIZE, "Transient buffer is full, TRANSIENT_BUFFER_FRAME_SIZE is too small");
+    rbs.transient_buffer_used = offset + size;
+    offset += rbs.current_frame * TRANSIENT_BUFFER_FRAME_SIZE;
+
+    return {
+        .buffer = rbs.transient_buffer,
+        .offset = offset,
+        .data = rbs.transient_buffer_mapped + offset
+    };
+}
+
+static void bind_constant_buffers(VkCommandBuffer cmd, RenderBackendPipeline* pipeline)
+{
+    if (pipeline->constant_buffers_num == 0)
+        return;
+
+    if (pipeline->constant_buffers_dirty || pipeline->constant_buffers_frame != rbs.frame_number)
     {
-        vkDestroyBuffer(rbs.device, rbs.debug_vertex_buffers[frame_idx][i], NULL);
-        vkFreeMemory(rbs.device, rbs.debug_vertex_buffers_memory[frame_idx][i], NULL);
+        let alignment = (u32)rbs.gpu_properties.limits.minUniformBufferOffsetAlignment;
+
+        for (u32 i = 0; i < pipeline->constant_buffers_num; ++i)
+        {
+            let cb = pipeline->constant_buffers + i;
+            let ta = transient_alloc(cb->size, alignment);
+            memcpy(ta.data, cb->data, cb->size);
+            cb->transient_offset = ta.offset;
+        }
+
+        pipeline->constant_buffers_dirty = false;
+        pipeline->constant_buffers_frame = rbs.frame_number;
     }
-    da_free(rbs.debug_vertex_buffers[frame_idx]);
-    da_free(rbs.debug_vertex_buffers_memory[frame_idx]);
+
+    u32 dynamic_offsets[MAX_CONSTANT_BUFFERS];
+
+    for (u32 i = 0; i < pipeline->constant_buffers_num; ++i)
+        dynamic_offsets[i] = pipeline->constant_buffers[i].transient_offset;
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 0, 1,
+                            &pipeline->constant_buffer_descriptor_sets[rbs.current_frame], pipeline->constant_buffers_num, dynamic_offsets);
+}
+
+static void read_gpu_frame_time(u32 frame_idx)
+{
+    if (!rbs.timestamp_query_pool || !rbs.timestamps_written[frame_idx])
+        return;
+
+    u64 timestamps[2];
+    VkResult res = vkGetQueryPoolResults(rbs.device, rbs.timestamp_query_pool, frame_idx * 2, 2, sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+
+    if (res == VK_SUCCESS)
+        rbs.frame_timings.gpu_ms = (f32)(timestamps[1] - timestamps[0]) * rbs.gpu_properties.limits.timestampPeriod / 1000000.0f;
+
+    rbs.timestamps_written[frame_idx] = false;
 }
 
 void renderer_backend_begin_frame(RenderBackendPipeline* pipeline)
 {
     VkResult res;
     let cf = rbs.current_frame;
-    vkWaitForFences(rbs.device, 1, &rbs.image_in_flight_fences[cf], VK_TRUE, UINT64_MAX);
+    let begin_ns = get_time_ns();
 
-    destroy_debug_vertex_buffers(cf);
+    if (rbs.frame_begin_ns)
+        rbs.frame_timings.frame_ms = (begin_ns - rbs.frame_begin_ns) / 1000000.0f;
+
+    rbs.frame_begin_ns = begin_ns;
+
+    // Only blocks if the GPU is more than MAX_FRAMES_IN_FLIGHT frames behind.
+    vkWaitForFences(rbs.device, 1, &rbs.image_in_flight_fences[cf], VK_TRUE, UINT64_MAX);
+    vkWaitForFences(rbs.device, 1, &rbs.upload_fences[cf], VK_TRUE, UINT64_MAX);
+    free_submitted_uploads(cf);
+    read_gpu_frame_time(cf);
+    rbs.transient_buffer_used = 0;
+    ++rbs.frame_number;
 
     u32 timeout = 100000000; // 0.1 s
     res = vkAcquireNextImageKHR(rbs.device, rbs.swapchain, timeout, rbs.image_available_semaphores[cf], VK_NULL_HANDLE, &rbs.image_index[cf]);
@@ -1299,109 +1712,21 @@ void renderer_backend_begin_frame(RenderBackendPipeline* pipeline)
 
     VERIFY_RES();
 
+    // The swapchain can hand out an image an older frame in flight still draws to.
+    SwapchainBuffer* scb = &rbs.swapchain_buffers[rbs.image_index[cf]];
+
+    if (scb->in_flight_fence != VK_NULL_HANDLE && scb->in_flight_fence != rbs.image_in_flight_fences[cf])
+        vkWaitForFences(rbs.device, 1, &scb->in_flight_fence, VK_TRUE, UINT64_MAX);
+
+    scb->in_flight_fence = rbs.image_in_flight_fences[cf];
+    rbs.frame_cpu_begin_ns = get_time_ns();
+    rbs.frame_timings.wait_ms = (rbs.frame_cpu_begin_ns - begin_ns) / 1000000.0f;
+
     // We are now sure that stuff for frame cf is not inuse, reset command buffers from that pool and put recycled counter to zero:
     res = vkResetCommandPool(rbs.device, rbs.graphics_cmd_pools[cf], VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
     VERIFY_RES();
     rbs.command_buffers_recycled[cf] = 0;
 
-    {
-        let cmd = get_new_command_buffer();
-
-        VkCommandBufferBeginInfo cbbi = {};
-        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        res = vkBeginCommandBuffer(cmd, &cbbi);
-        VERIFY_RES();
-
-        SwapchainBuffer* scb = &rbs.swapchain_buffers[cf];
-
-        VkImageMemoryBarrier clear_color_layout_barrier = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .dstQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .image = scb->image,
-            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .subresourceRange.layerCount = 1,
-            .subresourceRange.levelCount= 1
-        };
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &clear_color_layout_barrier);
-        VkClearColorValue color_clear = {
-            { 0, 0, 0, 1.0f } // R, G, B, A
-        };
-        vkCmdClearColorImage(cmd, scb->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color_clear, 1, &clear_color_layout_barrier.subresourceRange);
-
-        VkImageMemoryBarrier clear_color_layout_barrier_to_optimal = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-            .srcQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .dstQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .image = scb->image,
-            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .subresourceRange.layerCount = 1,
-            .subresourceRange.levelCount= 1
-        };
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &clear_color_layout_barrier_to_optimal);
-
-        VkClearDepthStencilValue ds_clear = { .depth = 1.0f };
-
-        VkImageMemoryBarrier clear_ds_layout_barrier = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .dstQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .image = rbs.depth_buffer.image,
-            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-            .subresourceRange.layerCount = 1,
-            .subresourceRange.levelCount= 1
-        };
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &clear_ds_layout_barrier);
-        vkCmdClearDepthStencilImage(cmd, rbs.depth_buffer.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &ds_clear, 1, &clear_ds_layout_barrier.subresourceRange);
-
-        VkImageMemoryBarrier clear_ds_layout_barrier_to_attachment = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-            .srcQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .dstQueueFamilyIndex = rbs.graphics_queue_family_idx,
-            .image = rbs.depth_buffer.image,
-            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-            .subresourceRange.layerCount = 1,
-            .subresourceRange.levelCount= 1
-        };
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &clear_ds_layout_barrier_to_attachment);
-
-        VkSubmitInfo si = {}; // can be mupltiple!!
-        si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        si.pWaitSemaphores = &rbs.image_available_semaphores[cf];
-        si.waitSemaphoreCount = 1;
-        VkPipelineStageFlags psf = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT;
-        si.pWaitDstStageMask = &psf;
-        si.commandBufferCount = 1;
-        si.pCommandBuffers = &cmd;
-
-        res = vkEndCommandBuffer(cmd);
-        VERIFY_RES();
-
-        res = vkQueueSubmit(rbs.graphics_queue, 1, &si, VK_NULL_HANDLE);
-        VERIFY_RES();
-
-        renderer_backend_wait_until_idle();
-    }
-
     check(rbs.current_frame_cmd == VK_NULL_HANDLE, "begin_frame called without previous frame having been presented");
     rbs.current_frame_cmd = get_new_command_buffer();
     let cmd = rbs.current_frame_cmd;
@@ -1411,62 +1736,109 @@ void renderer_backend_begin_frame(RenderBackendPipeline* pipeline)
     res = vkBeginCommandBuffer(cmd, &cbbi);
     VERIFY_RES();
 
-    SwapchainBuffer* scb = &rbs.swapchain_buffers[cf];
+    if (rbs.timestamp_query_pool)
+    {
+        vkCmdResetQueryPool(cmd, rbs.timestamp_query_pool, cf * 2, 2);
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, rbs.timestamp_query_pool, cf * 2);
+    }
+
+    VkClearValue clear_values[2] = {};
+    clear_values[0].color = {{ 0, 0, 0, 1.0f }}; // R, G, B, A
+    clear_values[1].depthStencil = { .depth = 1.0f };
 
     VkRenderPassBeginInfo rpbi = {};
     rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    rpbi.renderPass = rbs.draw_render_pass;
+    rpbi.renderPass = rbs.draw_render_pass_clear;
     rpbi.framebuffer = scb->framebuffer;
     rpbi.renderArea.extent.width = rbs.swapchain_size.x;
     rpbi.renderArea.extent.height = rbs.swapchain_size.y;
+    rpbi.clearValueCount = 2;
+    rpbi.pClearValues = clear_values;
     vkCmdBeginRenderPass(cmd, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->vk_handle);
 
-    if (pipeline->constant_buffers_num)
-    {
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 0, pipeline->constant_buffers_num,
-                                pipeline->constant_buffer_descriptor_sets[cf], 0, NULL);
-    }
+    // Dynamic state lasts the whole command buffer, so it's set once here instead of per draw.
+    VkViewport viewport = {};
+    viewport.width = rbs.swapchain_size.x;
+    viewport.height = rbs.swapchain_size.y;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    viewport.x = 0;
+    viewport.y = 0;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.extent.width = rbs.swapchain_size.x;
+    scissor.extent.height = rbs.swapchain_size.y;
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
 }
 
-void renderer_backend_draw(RenderBackendPipeline* pipeline, RenderBackendMesh* mesh, const Mat4& mvp, const Mat4& model)
+void renderer_backend_draw(RenderBackendPipeline* pipeline, RenderBackendMesh* mesh, const Mat4* models, u32 instances_num, const Mat4& view_projection)
 {
     check(rbs.current_frame_cmd != VK_NULL_HANDLE, "draw called without begin_frame having been called first");
     let cmd = rbs.current_frame_cmd;
 
-    Mat4 pc[2] = {mvp, model};
+    let instances = transient_alloc(sizeof(Mat4) * instances_num, 16);
+    memcpy(instances.data, models, sizeof(Mat4) * instances_num);
+    bind_constant_buffers(cmd, pipeline);
 
     vkCmdPushConstants(
         cmd,
         pipeline->layout,
         VK_SHADER_STAGE_VERTEX_BIT,
         0,
-        sizeof(pc),
-        pc);
+        sizeof(view_projection),
+        &view_projection);
 
-    VkDeviceSize offsets[1] = {0};
-    VkBuffer vertex_buffer = mesh->vertex_buffer;
-    vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer, offsets);
+    VkDeviceSize offsets[2] = {0, instances.offset};
+    VkBuffer vertex_buffers[2] = {mesh->vertex_buffer, instances.buffer};
+    vkCmdBindVertexBuffers(cmd, 0, 2, vertex_buffers, offsets);
     vkCmdBindIndexBuffer(cmd, mesh->index_buffer, 0, get_index_type(0));
+    vkCmdDrawIndexed(cmd, mesh->indices_num, instances_num, 0, 0, 0);
+}
 
-    VkViewport viewport = {};
-    viewport.width = rbs.swapchain_size.x;
-    viewport.height = rbs.swapchain_size.y;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    viewport.x = 0;
-    viewport.y = 0;
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
+// Copies all pending uploads in one submission on the transfer queue.
+// Returns false if there was nothing to upload.
+static bool submit_mesh_uploads(u32 frame_idx)
+{
+    if (da_num(rbs.pending_uploads) == 0)
+        return false;
 
-    VkRect2D scissor = {};
-    scissor.extent.width = rbs.swapchain_size.x;
-    scissor.extent.height = rbs.swapchain_size.y;
-    scissor.offset.x = 0;
-    scissor.offset.y = 0;
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
+    VkResult res = vkResetCommandPool(rbs.device, rbs.transfer_cmd_pools[frame_idx], 0);
+    VERIFY_RES();
+    let cmd = rbs.transfer_cmds[frame_idx];
+    VkCommandBufferBeginInfo cbbi = {};
+    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    res = vkBeginCommandBuffer(cmd, &cbbi);
+    VERIFY_RES();
+
+    da_foreach(u, rbs.pending_uploads)
+    {
+        VkBufferCopy bc = {};
+        bc.size = u->size;
+        vkCmdCopyBuffer(cmd, u->staging_buffer, u->dst_buffer, 1, &bc);
+        da_push(rbs.submitted_uploads[frame_idx], *u);
+    }
+
+    da_clear(rbs.pending_uploads);
+    res = vkEndCommandBuffer(cmd);
+    VERIFY_RES();
+
+    VkSubmitInfo si = {};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &cmd;
+    si.pSignalSemaphores = &rbs.upload_finished_semaphores[frame_idx];
+    si.signalSemaphoreCount = 1;
 
-    vkCmdDrawIndexed(cmd, mesh->indices_num, 1, 0, 0, 0);
+    vkResetFences(rbs.device, 1, &rbs.upload_fences[frame_idx]);
+    res = vkQueueSubmit(rbs.transfer_queue, 1, &si, rbs.upload_fences[frame_idx]);
+    VERIFY_RES();
+    return true;
 }
 
 void renderer_backend_present()
@@ -1481,8 +1853,32 @@ void renderer_backend_present()
     res = vkEndCommandBuffer(cmd);
     VERIFY_RES();
 
+    // Debug drawing records command buffers after the frame one, so the end
+    // timestamp goes in one of its own that is submitted last.
+    if (rbs.timestamp_query_pool)
+    {
+        let timestamp_cmd = get_new_command_buffer();
+        VkCommandBufferBeginInfo cbbi = {};
+        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        res = vkBeginCommandBuffer(timestamp_cmd, &cbbi);
+        VERIFY_RES();
+        vkCmdWriteTimestamp(timestamp_cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, rbs.timestamp_query_pool, cf * 2 + 1);
+        res = vkEndCommandBuffer(timestamp_cmd);
+        VERIFY_RES();
+        rbs.timestamps_written[cf] = true;
+    }
+
+    // Meshes created this frame are drawn by it, so it waits for their upload.
+    let uploading = submit_mesh_uploads(cf);
+    VkSemaphore wait_semaphores[2] = {rbs.image_available_semaphores[cf], rbs.upload_finished_semaphores[cf]};
+    VkPipelineStageFlags psf[2] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+
     VkSubmitInfo si = {}; // can be mupltiple!!
     si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.pWaitSemaphores = wait_semaphores;
+    si.waitSemaphoreCount = uploading ? 2 : 1;
+    si.pWaitDstStageMask = psf;
     si.commandBufferCount = rbs.command_buffers_recycled[cf];
     si.pCommandBuffers = rbs.command_buffers[cf];
     si.pSignalSemaphores = &rbs.render_finished_semaphores[cf];
@@ -1503,6 +1899,40 @@ void renderer_backend_present()
     vkQueuePresentKHR(rbs.present_queue, &pi);
     rbs.current_frame = (rbs.current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
     rbs.current_frame_cmd = VK_NULL_HANDLE;
+    rbs.frame_timings.cpu_ms = (get_time_ns() - rbs.frame_cpu_begin_ns) / 1000000.0f;
+}
+
+const RendererFrameTimings& renderer_backend_get_frame_timings()
+{
+    return rbs.frame_timings;
+}
+
+RendererMemoryStats renderer_backend_get_memory_stats()
+{
+    RendererMemoryStats stats = {};
+    u64 free_bytes = 0;
+
+    for (u32 type_idx = 0; type_idx < VK_MAX_MEMORY_TYPES; ++type_idx)
+    {
+        da_foreach(b, rbs.memory_pools[type_idx].blocks)
+        {
+            ++stats.blocks;
+            stats.allocations += b->allocations_num;
+            stats.block_bytes += b->size;
+            stats.used_bytes += b->used;
+            stats.free_ranges += da_num(b->free_ranges);
+            free_bytes += b->size - b->used;
+
+            da_foreach(r, b->free_ranges)
+            {
+                if (r->size > stats.largest_free_range)
+                    stats.largest_free_range = r->size;
+            }
+        }
+    }
+
+    stats.fragmentation = free_bytes > 0 ? 1.0f - (f32)stats.largest_free_range / (f32)free_bytes : 0.0f;
+    return stats;
 }
 
 void renderer_backend_wait_until_idle()
@@ -1524,39 +1954,8 @@ Vec2u renderer_backend_get_size()
 void renderer_backend_debug_draw(RenderBackendPipeline* debug_pipeline, const SimpleVertex* vertices, u32 vertices_num, const Mat4& view_projection)
 {
     VkResult res;
-    VkBuffer vertex_buffer;
-    VkDeviceMemory vertex_buffer_memory;
-
-    VkBufferCreateInfo vertex_bci = {};
-    vertex_bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    vertex_bci.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    vertex_bci.size = sizeof(SimpleVertex) * vertices_num;
-    vertex_bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    res = vkCreateBuffer(rbs.device, &vertex_bci, NULL, &vertex_buffer);
-    VERIFY_RES();
-
-    VkMemoryRequirements vertex_buffer_mr;
-    vkGetBufferMemoryRequirements(rbs.device, vertex_buffer, &vertex_buffer_mr);
-    VkMemoryAllocateInfo vertex_buffer_mai = {};
-    vertex_buffer_mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    vertex_buffer_mai.allocationSize = vertex_buffer_mr.size;
-    vertex_buffer_mai.memoryTypeIndex = memory_type_from_properties(vertex_buffer_mr.memoryTypeBits, &rbs.gpu_memory_properties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    check(vertex_buffer_mai.memoryTypeIndex != (u32)-1, "Couldn't find memory of correct type.");
-
-    res = vkAllocateMemory(rbs.device, &vertex_buffer_mai, NULL, &vertex_buffer_memory);
-    VERIFY_RES();
-
-    u8* vertex_buffer_memory_data;
-    res = vkMapMemory(rbs.device, vertex_buffer_memory, 0, vertex_buffer_mr.size, 0, (void**)&vertex_buffer_memory_data);
-    VERIFY_RES();
-
-    memcpy(vertex_buffer_memory_data, vertices, sizeof(SimpleVertex) * vertices_num);
-
-    vkUnmapMemory(rbs.device, vertex_buffer_memory);
-
-    res = vkBindBufferMemory(rbs.device, vertex_buffer, vertex_buffer_memory, 0);
-    VERIFY_RES();
+    let vertex_buffer = transient_alloc(sizeof(SimpleVertex) * vertices_num, 16);
+    memcpy(vertex_buffer.data, vertices, sizeof(SimpleVertex) * vertices_num);
 
     u32 cf = rbs.current_frame;
     VkCommandBufferBeginInfo cbbi = {};
@@ -1565,7 +1964,7 @@ void renderer_backend_debug_draw(RenderBackendPipeline* debug_pipeline, const Si
     res = vkBeginCommandBuffer(cmd, &cbbi);
     VERIFY_RES();
 
-    SwapchainBuffer* scb = &rbs.swapchain_buffers[cf];
+    SwapchainBuffer* scb = &rbs.swapchain_buffers[rbs.image_index[cf]];
 
     VkRenderPassBeginInfo rpbi = {};
     rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1577,14 +1976,8 @@ void renderer_backend_debug_draw(RenderBackendPipeline* debug_pipeline, const Si
     vkCmdBeginRenderPass(cmd, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, debug_pipeline->vk_handle);
+    bind_constant_buffers(cmd, debug_pipeline);
 
-    if (debug_pipeline->constant_buffers_num)
-    {
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, debug_pipeline->layout, 0, debug_pipeline->constant_buffers_num,
-                                debug_pipeline->constant_buffer_descriptor_sets[cf], 0, NULL);
-    }
-
-    
     vkCmdPushConstants(
         cmd,
         debug_pipeline->layout,
@@ -1593,8 +1986,8 @@ void renderer_backend_debug_draw(RenderBackendPipeline* debug_pipeline, const Si
         sizeof(view_projection),
         &view_projection);
 
-    VkDeviceSize offsets[1] = {0};
-    vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer, offsets);
+    VkDeviceSize offset = vertex_buffer.offset;
+    vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer.buffer, &offset);
 
     VkViewport viewport = {};
     viewport.width = rbs.swapchain_size.x;
@@ -1617,7 +2010,4 @@ void renderer_backend_debug_draw(RenderBackendPipeline* debug_pipeline, const Si
     vkCmdEndRenderPass(cmd);
     res = vkEndCommandBuffer(cmd);
     VERIFY_RES();
-
-    da_push(rbs.debug_vertex_buffers[cf], vertex_buffer);
-    da_push(rbs.debug_vertex_buffers_memory[cf], vertex_buffer_memory);
 }
\ No newline at end of file
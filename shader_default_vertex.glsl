@@ -4,14 +4,14 @@
 
 layout(push_constant) uniform Matrices
 {
-    mat4 mvp;
-    mat4 model;
+    mat4 view_projection;
 };
 
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec4 in_color;
 layout (location = 3) in vec2 in_texcoord;
+layout (location = 4) in mat4 in_model; // per instance, takes locations 4 to 7
 
 layout (location = 0) out vec4 out_pos;
 layout (location = 1) out vec4 out_world_pos;
@@ -20,9 +20,9 @@ layout (location = 3) out vec2 out_texcoord;
 layout (location = 4) out vec4 out_color;
 
 void main() {
-    out_pos = mvp * vec4(in_pos, 1);
-    out_world_pos = vec4(in_pos * mat3(model), 1);
-    out_normal = normalize(mat3(model) * in_normal);
+    out_pos = view_projection * in_model * vec4(in_pos, 1);
+    out_world_pos = vec4(in_pos * mat3(in_model), 1);
+    out_normal = normalize(mat3(in_model) * in_normal);
     out_texcoord = in_texcoord;
     out_color = in_color;
 
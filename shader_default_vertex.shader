@@ -1,13 +1,8 @@
 push_constant = [
     {
-        name = "mvp"
+        name = "view_projection"
         type = "mat4"
-        value = "mat_model_view_projection"
-    },
-    {
-        name = "model"
-        type = "mat4"
-        value = "mat_model"
+        value = "mat_view_projection"
     }
 ]
 
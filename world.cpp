@@ -4,6 +4,7 @@
 #include "dynamic_array.h"
 #include "physics.h"
 #include "renderer.h"
+#include "math.h"
 
 World* create_world(RenderWorld* render_world, PhysicsWorld* physics_world)
 {
@@ -28,11 +29,17 @@ void destroy_world(World* w)
 
     da_free(w->entities);
     da_free(w->entities_free_idx);
+    da_free(w->physics_object_entities);
     memf(w);
 }
 
 void World::destroy_entity(u32 entity_idx)
 {
+    let physics_object_idx = this->entities[entity_idx].physics_object_idx;
+
+    if (physics_object_idx)
+        this->physics_object_entities[physics_object_idx] = 0;
+
     memzero(this->entities + entity_idx, sizeof(EntityInt));
     da_push(this->entities_free_idx, entity_idx);
 }
@@ -61,18 +68,33 @@ void World::update()
 {
     physics_update_world(this->physics_world);
 
-    da_foreach(e, this->entities)
+    // Walks the rigidbody state in physics order, so the reads are linear.
+    let states = physics_get_rigidbody_states(this->physics_world);
+    let entities_lut = this->physics_object_entities;
+    let entities_lut_num = da_num(entities_lut);
+
+    for (u32 i = 0; i < states.num; ++i)
     {
-        if (!e->physics_rigidbody_idx)
+        // Sleeping rigidbodies don't move, entity and render object are already in sync.
+        if (states.sleeping[i])
+            continue;
+
+        let object_idx = states.object_indices[i];
+        let entity_idx = object_idx < entities_lut_num ? entities_lut[object_idx] : 0;
+
+        if (!entity_idx)
             continue;
-        
-        let pos = physics_get_position(e->world->physics_world, e->physics_object_idx);
-        let rot = physics_get_rotation(e->world->physics_world, e->physics_object_idx);
 
-        e->pos = pos;
-        e->rot = rot;
+        let e = this->entities + entity_idx;
+        e->pos = states.positions[i];
+        e->rot = states.rotations[i];
 
+        // Entity keeps the simulated state, rendering gets it blended between physics steps.
         if (e->render_object_idx)
-            renderer_world_set_position_and_rotation(e->world->render_world, e->render_object_idx, e->pos, e->rot);
+        {
+            let render_pos = lerp(states.prev_positions[i], states.positions[i], states.interpolation_alpha);
+            let render_rot = nlerp(states.prev_rotations[i], states.rotations[i], states.interpolation_alpha);
+            renderer_world_set_position_and_rotation(this->render_world, e->render_object_idx, render_pos, render_rot);
+        }
     }
 }
\ No newline at end of file
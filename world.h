@@ -17,6 +17,7 @@ struct World
     PhysicsWorld* physics_world;
     EntityInt* entities; // dynamic
     u32* entities_free_idx; // dynamic
+    u32* physics_object_entities; // dynamic, physics object index -> entity index, zero if none
 };
 
 World* create_world(RenderWorld* render_world, PhysicsWorld* physics_world);